@@ -0,0 +1,188 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "Client.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace cctag {
+namespace daemon {
+
+static std::runtime_error SystemError(const std::string & what)
+{
+  return std::runtime_error("cctagd client: " + what + ": " + std::strerror(errno));
+}
+
+Client::Client(const std::string & socketPath)
+  : _socket(-1)
+  , _ring(nullptr)
+  , _ringSize(0)
+  , _buffer(MaxMessageSize)
+{
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(socketPath.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("cctagd client: socket path too long");
+  std::strcpy(addr.sun_path, socketPath.c_str());
+
+  _socket = ::socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if(_socket < 0)
+    throw SystemError("socket");
+  if(::connect(_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+  {
+    ::close(_socket);
+    throw SystemError("connect to " + socketPath);
+  }
+
+  try
+  {
+    if(receiveMessage() != sizeof(Hello))
+      throw std::runtime_error("cctagd client: no greeting from the daemon");
+    std::memcpy(&_hello, _buffer.data(), sizeof(Hello));
+    if(_hello.type != MsgHello || _hello.version != ProtocolVersion)
+      throw std::runtime_error("cctagd client: unsupported protocol version");
+    _hello.ringName[sizeof(_hello.ringName) - 1] = 0;
+
+    const int fd = ::shm_open(_hello.ringName, O_RDWR, 0);
+    if(fd < 0)
+      throw SystemError(std::string("shm_open ") + _hello.ringName);
+    struct stat st;
+    if(::fstat(fd, &st) < 0)
+    {
+      ::close(fd);
+      throw SystemError("fstat");
+    }
+    _ringSize = st.st_size;
+    void* ring = ::mmap(nullptr, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(ring == MAP_FAILED)
+      throw SystemError("mmap");
+    _ring = static_cast<unsigned char*>(ring);
+
+    const RingHeader* header = reinterpret_cast<const RingHeader*>(_ring);
+    if(_ringSize < sizeof(RingHeader) ||
+       std::memcmp(header->magic, RingMagic, sizeof(RingMagic)) != 0 ||
+       header->slotSize != _hello.slotSize ||
+       header->dataOffset + header->slotCount * header->slotSize > _ringSize)
+      throw std::runtime_error("cctagd client: invalid frame ring");
+  }
+  catch(...)
+  {
+    if(_ring)
+      ::munmap(_ring, _ringSize);
+    ::close(_socket);
+    throw;
+  }
+}
+
+Client::~Client()
+{
+  ::munmap(_ring, _ringSize);
+  ::close(_socket);
+}
+
+unsigned char* Client::slotData(int slot) const
+{
+  const RingHeader* header = reinterpret_cast<const RingHeader*>(_ring);
+  return _ring + header->dataOffset + std::size_t(slot) * header->slotSize;
+}
+
+int Client::acquire()
+{
+  const Acquire message = { MsgAcquire };
+  send(&message, sizeof(message));
+  // results may arrive before the answer; keep them for receive()
+  while(true)
+  {
+    const std::size_t size = receiveMessage();
+    if(size == 0)
+      throw std::runtime_error("cctagd client: connection closed");
+    const uint32_t type = *reinterpret_cast<const uint32_t*>(_buffer.data());
+    if(type == MsgSlot && size == sizeof(Slot))
+      return reinterpret_cast<const Slot*>(_buffer.data())->slot;
+    FrameResult result;
+    if(decodeResult(size, result))
+      _pending.push_back(std::move(result));
+  }
+}
+
+void Client::submit(int slot, uint64_t frameId, uint32_t width, uint32_t height, uint32_t stride, FrameFormat format)
+{
+  const Submit message = { MsgSubmit, uint32_t(slot), frameId, width, height, stride, format };
+  send(&message, sizeof(message));
+}
+
+void Client::subscribe()
+{
+  const Subscribe message = { MsgSubscribe };
+  send(&message, sizeof(message));
+}
+
+bool Client::receive(FrameResult & result)
+{
+  if(!_pending.empty())
+  {
+    result = std::move(_pending.front());
+    _pending.erase(_pending.begin());
+    return true;
+  }
+
+  while(true)
+  {
+    const std::size_t size = receiveMessage();
+    if(size == 0)
+      return false;
+    if(decodeResult(size, result))
+      return true;
+  }
+}
+
+bool Client::decodeResult(std::size_t size, FrameResult & result) const
+{
+  const Result* r = reinterpret_cast<const Result*>(_buffer.data());
+  if(size < sizeof(Result) || r->type != MsgResult ||
+     size != sizeof(Result) + r->markerCount * sizeof(Marker))
+    return false;
+  const Marker* markers = reinterpret_cast<const Marker*>(_buffer.data() + sizeof(Result));
+  result._clientId = r->clientId;
+  result._frameId = r->frameId;
+  result._error = r->error != 0;
+  result._markers.assign(markers, markers + r->markerCount);
+  return true;
+}
+
+void Client::send(const void* message, std::size_t size)
+{
+  if(::send(_socket, message, size, MSG_NOSIGNAL) != ssize_t(size))
+    throw SystemError("send");
+}
+
+std::size_t Client::receiveMessage()
+{
+  while(true)
+  {
+    const ssize_t size = ::recv(_socket, _buffer.data(), _buffer.size(), 0);
+    if(size < 0 && errno == EINTR)
+      continue;
+    if(size < 0)
+      throw SystemError("recv");
+    return size;
+  }
+}
+
+} // namespace daemon
+} // namespace cctag
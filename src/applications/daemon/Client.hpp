@@ -0,0 +1,89 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "Protocol.hpp"
+
+#include <string>
+#include <vector>
+
+namespace cctag {
+namespace daemon {
+
+/**
+ * @brief Markers detected by the daemon in one frame.
+ */
+struct FrameResult
+{
+  uint32_t _clientId;       // client that submitted the frame
+  uint64_t _frameId;
+  bool _error;
+  std::vector<Marker> _markers;
+};
+
+/**
+ * @brief Connection to the detection daemon. Not thread-safe.
+ */
+class Client
+{
+public:
+  /**
+   * @brief Connect to the daemon and map its frame ring. Throws std::runtime_error on failure.
+   */
+  explicit Client(const std::string & socketPath);
+  ~Client();
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  uint32_t clientId() const { return _hello.clientId; }
+  std::size_t slotSize() const { return _hello.slotSize; }
+
+  /**
+   * @brief Reserve a slot of the ring; returns -1 if all are in use.
+   */
+  int acquire();
+
+  /**
+   * @brief Memory of a slot, to write the frame into.
+   */
+  unsigned char* slotData(int slot) const;
+
+  /**
+   * @brief Hand the frame in an acquired slot over to the daemon. The slot
+   * must not be touched until the result arrives.
+   */
+  void submit(int slot, uint64_t frameId, uint32_t width, uint32_t height, uint32_t stride, FrameFormat format);
+
+  /**
+   * @brief Receive the results of the frames submitted by all clients, not only ours.
+   */
+  void subscribe();
+
+  /**
+   * @brief Wait for the next result. Returns false if the daemon closed the connection.
+   */
+  bool receive(FrameResult & result);
+
+private:
+  void send(const void* message, std::size_t size);
+  // Returns the size of the message, 0 on disconnection.
+  std::size_t receiveMessage();
+  // Returns false if the received message is not a valid Result.
+  bool decodeResult(std::size_t size, FrameResult & result) const;
+
+  int _socket;
+  Hello _hello;
+  unsigned char* _ring;
+  std::size_t _ringSize;
+  std::vector<unsigned char> _buffer;
+  std::vector<FrameResult> _pending;   // results received while waiting for a Slot
+};
+
+} // namespace daemon
+} // namespace cctag
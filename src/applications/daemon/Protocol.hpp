@@ -0,0 +1,121 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+// Protocol between the detection daemon (cctagd) and its clients.
+//
+// Frames travel through a POSIX shared-memory ring of fixed-size slots that the
+// daemon creates; only small messages travel over the Unix socket
+// (SOCK_SEQPACKET, one message per packet):
+//   1. on connection, the daemon sends Hello with the ring name and geometry;
+//   2. a producer sends Acquire and gets a free slot index in Slot (or -1),
+//      writes its frame into the slot and sends Submit;
+//   3. the daemon detects the markers, frees the slot, and sends Result to the
+//      submitter and to every client that sent Subscribe.
+// Slot ownership is only tracked by the daemon; the socket messages order the
+// accesses to the shared memory.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cctag {
+namespace daemon {
+
+const char RingMagic[8] = { 'C', 'C', 'T', 'A', 'G', 'S', 'H', 'M' };
+const uint32_t ProtocolVersion = 1;
+
+// At the start of the shared memory; slot i starts at dataOffset + i * slotSize.
+struct RingHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t slotCount;
+  uint64_t slotSize;
+  uint64_t dataOffset;
+};
+
+enum MessageType : uint32_t
+{
+  MsgHello = 1,     // daemon -> client
+  MsgAcquire,       // client -> daemon
+  MsgSlot,          // daemon -> client, answer to Acquire
+  MsgSubmit,        // client -> daemon
+  MsgSubscribe,     // client -> daemon
+  MsgResult         // daemon -> client
+};
+
+// Pixel layouts, as cctag::LumaFormat.
+enum FrameFormat : uint32_t
+{
+  FormatGray = 0,
+  FormatYUYV,
+  FormatNV12
+};
+
+struct Hello
+{
+  uint32_t type;            // MsgHello
+  uint32_t version;
+  uint32_t clientId;
+  uint32_t slotCount;
+  uint64_t slotSize;
+  char     ringName[64];    // for shm_open
+};
+
+struct Acquire
+{
+  uint32_t type;            // MsgAcquire
+};
+
+struct Slot
+{
+  uint32_t type;            // MsgSlot
+  int32_t  slot;            // -1 if all slots are in use
+};
+
+struct Submit
+{
+  uint32_t type;            // MsgSubmit
+  uint32_t slot;
+  uint64_t frameId;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint32_t format;          // FrameFormat
+};
+
+struct Subscribe
+{
+  uint32_t type;            // MsgSubscribe
+};
+
+struct Marker
+{
+  int32_t id;
+  int32_t status;
+  float   x;
+  float   y;
+  float   quality;
+};
+
+// Followed by markerCount Marker.
+struct Result
+{
+  uint32_t type;            // MsgResult
+  uint32_t clientId;        // submitter
+  uint64_t frameId;
+  uint32_t markerCount;
+  uint32_t error;           // non-zero if the frame was rejected or its detection failed
+};
+
+// Larger than any result sent by the daemon.
+const uint32_t MaxMarkers = 4096;
+const std::size_t MaxMessageSize = sizeof(Result) + MaxMarkers * sizeof(Marker);
+
+} // namespace daemon
+} // namespace cctag
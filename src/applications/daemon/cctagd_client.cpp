@@ -0,0 +1,108 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// cctagd-client: example client of the detection daemon. Either submits the
+// frames of an image or video and prints their markers, or, with --subscribe,
+// prints the markers of the frames submitted by all clients.
+
+#include "Client.hpp"
+
+#include <boost/program_options.hpp>
+#include <opencv2/opencv.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace cctag::daemon;
+
+static void Print(const FrameResult& result)
+{
+  std::cout << "client " << result._clientId << " frame " << result._frameId;
+  if (result._error)
+    std::cout << " rejected";
+  std::cout << ": " << result._markers.size() << " markers\n";
+  for (const auto& m: result._markers)
+    std::cout << "  " << m.x << " " << m.y << " " << m.id << " " << m.status << "\n";
+  std::cout << std::flush;
+}
+
+static void SubmitFrames(Client& client, const std::string& input)
+{
+  cv::VideoCapture video(input);
+  if (!video.isOpened())
+    throw std::runtime_error("unable to open " + input);
+  
+  cv::Mat frame, gray;
+  for (uint64_t frameId = 0; video.read(frame); ++frameId) {
+    if (frame.channels() == 1)
+      gray = frame;
+    else
+      cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    if (size_t(gray.cols) * gray.rows > client.slotSize())
+      throw std::runtime_error("frame larger than the daemon's slots");
+    
+    const int slot = client.acquire();
+    if (slot < 0)
+      throw std::runtime_error("no free slot in the daemon's ring");
+    unsigned char* data = client.slotData(slot);
+    for (int y = 0; y < gray.rows; ++y)
+      std::memcpy(data + y * gray.cols, gray.ptr(y), gray.cols);
+    client.submit(slot, frameId, gray.cols, gray.rows, gray.cols, FormatGray);
+    
+    // wait for our own result; results of other clients' frames only come with --subscribe
+    FrameResult result;
+    do {
+      if (!client.receive(result))
+        throw std::runtime_error("daemon closed the connection");
+    } while (result._clientId != client.clientId() || result._frameId != frameId);
+    Print(result);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  using namespace boost::program_options;
+  try {
+    std::string socketPath, input;
+    options_description desc("Options");
+    desc.add_options()
+      ("socket", value<std::string>(&socketPath)->default_value("/tmp/cctagd.sock"), "Daemon socket")
+      ("input", value<std::string>(&input), "Image or video to submit")
+      ("subscribe", "Print the results of all clients' frames")
+      ("help", "Print help");
+    
+    variables_map vm;
+    store(parse_command_line(argc, argv, desc), vm);
+    notify(vm);
+    if (vm.count("help") || (input.empty() && !vm.count("subscribe"))) {
+      std::cout << desc << std::endl;
+      return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    Client client(socketPath);
+    if (vm.count("subscribe")) {
+      client.subscribe();
+      FrameResult result;
+      while (client.receive(result))
+        Print(result);
+    }
+    else {
+      SubmitFrames(client, input);
+    }
+    return EXIT_SUCCESS;
+  }
+  catch (boost::program_options::error& e) {
+    std::cerr << "Failed to parse options: " << e.what() << std::endl;
+  }
+  catch (std::exception& e) {
+    std::cerr << "FATAL ERROR: " << e.what() << std::endl;
+  }
+  return EXIT_FAILURE;
+}
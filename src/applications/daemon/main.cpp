@@ -0,0 +1,392 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// cctagd: runs the CCTag detection once per frame for any number of local
+// clients. See Protocol.hpp for the protocol.
+
+#include "Protocol.hpp"
+#include "cctag/Detection.hpp"
+
+#include <boost/archive/xml_iarchive.hpp>
+#include <boost/program_options.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace cctag::daemon;
+
+static std::string SocketPath;
+static std::string RingName;
+static std::string ParametersFile;
+static std::string BankFile;
+static size_t NCrowns;
+static uint32_t SlotCount;
+static uint32_t MaxWidth;
+static uint32_t MaxHeight;
+
+static volatile sig_atomic_t Stop = 0;
+
+static void OnSignal(int)
+{
+  Stop = 1;
+}
+
+static std::runtime_error SystemError(const std::string& what)
+{
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+static bool ParseOptions(int argc, char **argv)
+{
+  using namespace boost::program_options;
+  
+  options_description desc("Options");
+  desc.add_options()
+    ("socket", value<std::string>(&SocketPath)->default_value("/tmp/cctagd.sock"), "Unix socket to listen on")
+    ("ring", value<std::string>(&RingName)->default_value("/cctagd"), "Name of the shared-memory frame ring")
+    ("slots", value<uint32_t>(&SlotCount)->default_value(8), "Number of frames in the ring")
+    ("max-width", value<uint32_t>(&MaxWidth)->default_value(1920), "Largest frame width")
+    ("max-height", value<uint32_t>(&MaxHeight)->default_value(1080), "Largest frame height")
+    ("nbrings", value<size_t>(&NCrowns)->default_value(3), "Number of rings of the markers")
+    ("parameters", value<std::string>(&ParametersFile), "Detection parameters file")
+    ("bank", value<std::string>(&BankFile), "Marker bank file")
+    ("help", "Print help");
+  
+  variables_map vm;
+  store(parse_command_line(argc, argv, desc), vm);
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return false;
+  }
+  notify(vm);
+  if (SlotCount == 0 || MaxWidth == 0 || MaxHeight == 0)
+    throw error("slots, max-width and max-height must be positive");
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+// Shared-memory ring of frame slots, owned by the daemon.
+class FrameRing
+{
+  std::string _name;
+  unsigned char* _data;
+  size_t _size;
+  
+public:
+  FrameRing(const std::string& name, uint32_t slotCount, uint64_t slotSize) : _name(name)
+  {
+    const uint64_t dataOffset = 4096;   // keep the slots page-aligned
+    _size = dataOffset + slotCount * slotSize;
+    
+    ::shm_unlink(name.c_str());         // left over by a daemon that crashed
+    const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+      throw SystemError("shm_open " + name);
+    if (::ftruncate(fd, _size) < 0) {
+      ::close(fd);
+      ::shm_unlink(name.c_str());
+      throw SystemError("ftruncate");
+    }
+    void* data = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      ::shm_unlink(name.c_str());
+      throw SystemError("mmap");
+    }
+    _data = static_cast<unsigned char*>(data);
+    
+    RingHeader* header = reinterpret_cast<RingHeader*>(_data);
+    std::memcpy(header->magic, RingMagic, sizeof(RingMagic));
+    header->version = ProtocolVersion;
+    header->slotCount = slotCount;
+    header->slotSize = slotSize;
+    header->dataOffset = dataOffset;
+  }
+  
+  ~FrameRing()
+  {
+    ::munmap(_data, _size);
+    ::shm_unlink(_name.c_str());
+  }
+  
+  FrameRing(const FrameRing&) = delete;
+  FrameRing& operator=(const FrameRing&) = delete;
+  
+  const RingHeader& header() const { return *reinterpret_cast<const RingHeader*>(_data); }
+  const unsigned char* slot(uint32_t i) const { return _data + header().dataOffset + i * header().slotSize; }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+
+class Daemon
+{
+  struct Connection
+  {
+    int fd;
+    uint32_t id;
+    bool subscribed;
+  };
+  
+  const cctag::Parameters& _parameters;
+  const cctag::CCTagMarkersBank& _bank;
+  FrameRing _ring;
+  int _listener;
+  std::vector<Connection> _connections;
+  std::vector<int64_t> _slotOwners;       // client id, -1 if free
+  uint32_t _nextClientId;
+  std::vector<unsigned char> _buffer;
+  
+  void accept();
+  void disconnect(size_t i);
+  // Returns false if the connection was closed.
+  bool handle(Connection& connection);
+  bool detect(const Connection& connection, const Submit& submit);
+  
+public:
+  Daemon(const cctag::Parameters& parameters, const cctag::CCTagMarkersBank& bank);
+  ~Daemon();
+  void run();
+};
+
+Daemon::Daemon(const cctag::Parameters& parameters, const cctag::CCTagMarkersBank& bank) :
+  _parameters(parameters), _bank(bank),
+  _ring(RingName, SlotCount, uint64_t(MaxWidth) * MaxHeight * 2),  // room for YUYV
+  _slotOwners(SlotCount, -1), _nextClientId(1), _buffer(MaxMessageSize)
+{
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("socket path too long");
+  std::strcpy(addr.sun_path, SocketPath.c_str());
+  
+  _listener = ::socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (_listener < 0)
+    throw SystemError("socket");
+  ::unlink(SocketPath.c_str());
+  if (::bind(_listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(_listener, 16) < 0) {
+    ::close(_listener);
+    throw SystemError("bind " + SocketPath);
+  }
+}
+
+Daemon::~Daemon()
+{
+  for (const auto& c: _connections)
+    ::close(c.fd);
+  ::close(_listener);
+  ::unlink(SocketPath.c_str());
+}
+
+void Daemon::run()
+{
+  std::clog << "cctagd: listening on " << SocketPath << ", ring " << RingName << " with " << SlotCount
+    << " slots of " << _ring.header().slotSize << " bytes" << std::endl;
+  
+  std::vector<pollfd> fds;
+  while (!Stop) {
+    fds.clear();
+    fds.push_back({ _listener, POLLIN, 0 });
+    for (const auto& c: _connections)
+      fds.push_back({ c.fd, POLLIN, 0 });
+    
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      throw SystemError("poll");
+    }
+    
+    // Connections are only appended by accept(), so the indices below stay valid
+    // when walking backwards and removing closed connections.
+    for (size_t i = fds.size() - 1; i > 0; --i)
+    if (fds[i].revents) {
+      if (!handle(_connections[i - 1]))
+        disconnect(i - 1);
+    }
+    if (fds[0].revents & POLLIN)
+      accept();
+  }
+}
+
+void Daemon::accept()
+{
+  const int fd = ::accept(_listener, nullptr, nullptr);
+  if (fd < 0)
+    return;
+  
+  Hello hello;
+  std::memset(&hello, 0, sizeof(hello));
+  hello.type = MsgHello;
+  hello.version = ProtocolVersion;
+  hello.clientId = _nextClientId++;
+  hello.slotCount = SlotCount;
+  hello.slotSize = _ring.header().slotSize;
+  std::strncpy(hello.ringName, RingName.c_str(), sizeof(hello.ringName) - 1);
+  if (::send(fd, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)) {
+    ::close(fd);
+    return;
+  }
+  _connections.push_back({ fd, hello.clientId, false });
+  std::clog << "cctagd: client " << hello.clientId << " connected" << std::endl;
+}
+
+void Daemon::disconnect(size_t i)
+{
+  const Connection c = _connections[i];
+  for (auto& owner: _slotOwners)
+    if (owner == c.id)
+      owner = -1;
+  ::close(c.fd);
+  _connections.erase(_connections.begin() + i);
+  std::clog << "cctagd: client " << c.id << " disconnected" << std::endl;
+}
+
+bool Daemon::handle(Connection& connection)
+{
+  const ssize_t size = ::recv(connection.fd, _buffer.data(), _buffer.size(), MSG_DONTWAIT);
+  if (size < 0)
+    return errno == EAGAIN || errno == EINTR;
+  if (size == 0 || size_t(size) < sizeof(uint32_t))
+    return false;
+  
+  const uint32_t type = *reinterpret_cast<const uint32_t*>(_buffer.data());
+  switch (type) {
+  case MsgAcquire: {
+    Slot slot = { MsgSlot, -1 };
+    for (size_t i = 0; i < _slotOwners.size(); ++i)
+    if (_slotOwners[i] < 0) {
+      _slotOwners[i] = connection.id;
+      slot.slot = i;
+      break;
+    }
+    return ::send(connection.fd, &slot, sizeof(slot), MSG_NOSIGNAL) == sizeof(slot);
+  }
+  case MsgSubmit: {
+    if (size_t(size) != sizeof(Submit))
+      return false;
+    // copied: the buffer is reused for the result
+    Submit submit;
+    std::memcpy(&submit, _buffer.data(), sizeof(submit));
+    return detect(connection, submit);
+  }
+  case MsgSubscribe:
+    connection.subscribed = true;
+    return true;
+  default:
+    std::clog << "cctagd: unexpected message " << type << " from client " << connection.id << std::endl;
+    return false;
+  }
+}
+
+// Returns false if the result could not be sent to the submitter.
+bool Daemon::detect(const Connection& connection, const Submit& submit)
+{
+  const uint64_t slotSize = _ring.header().slotSize;
+  const uint32_t bytesPerPixel = submit.format == FormatYUYV ? 2 : 1;
+  const bool valid =
+    submit.slot < SlotCount && _slotOwners[submit.slot] == connection.id &&
+    submit.format <= FormatNV12 && submit.width > 0 && submit.height > 0 &&
+    uint64_t(submit.width) * bytesPerPixel <= submit.stride &&
+    uint64_t(submit.stride) * submit.height <= slotSize;
+  
+  cctag::CCTag::List markers;
+  bool failed = false;
+  if (valid) {
+    const cctag::LumaFormat format =
+      submit.format == FormatYUYV ? cctag::LumaFormat::YUYV :
+      submit.format == FormatNV12 ? cctag::LumaFormat::NV12 : cctag::LumaFormat::Gray;
+    // A frame the detection cannot handle must not take the other clients down.
+    try {
+      cctag::cctagDetection(markers, 0, submit.frameId, _ring.slot(submit.slot),
+        submit.width, submit.height, submit.stride, format, _parameters, _bank);
+    }
+    catch (std::exception& e) {
+      std::clog << "cctagd: detection failed on frame " << submit.frameId << " of client "
+        << connection.id << ": " << e.what() << std::endl;
+      markers.clear();
+      failed = true;
+    }
+  }
+  if (submit.slot < SlotCount && _slotOwners[submit.slot] == connection.id)
+    _slotOwners[submit.slot] = -1;
+  
+  Result* result = reinterpret_cast<Result*>(_buffer.data());
+  Marker* out = reinterpret_cast<Marker*>(_buffer.data() + sizeof(Result));
+  result->type = MsgResult;
+  result->clientId = connection.id;
+  result->frameId = submit.frameId;
+  result->markerCount = 0;
+  result->error = !valid || failed;
+  for (const cctag::CCTag& marker: markers) {
+    if (result->markerCount == MaxMarkers)
+      break;
+    out[result->markerCount++] = { marker.id(), marker.getStatus(), marker.x(), marker.y(), marker.quality() };
+  }
+  const size_t size = sizeof(Result) + result->markerCount * sizeof(Marker);
+  
+  // The submitter waits for its result, which is therefore always sent. A subscriber
+  // that does not keep up loses results rather than delaying the others.
+  for (const auto& c: _connections)
+  if (c.id != connection.id && c.subscribed)
+    ::send(c.fd, _buffer.data(), size, MSG_NOSIGNAL | MSG_DONTWAIT);
+  return ::send(connection.fd, _buffer.data(), size, MSG_NOSIGNAL) == ssize_t(size);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+  try {
+    if (!ParseOptions(argc, argv))
+      return EXIT_SUCCESS;
+    
+    cctag::Parameters parameters(NCrowns);
+    if (!ParametersFile.empty()) {
+      std::ifstream ifs(ParametersFile);
+      if (!ifs)
+        throw std::runtime_error("unable to open " + ParametersFile);
+      boost::archive::xml_iarchive ia(ifs);
+      ia >> boost::serialization::make_nvp("CCTagsParams", parameters);
+    }
+    cctag::CCTagMarkersBank bank(parameters._nCrowns);
+    if (!BankFile.empty())
+      bank = cctag::CCTagMarkersBank(BankFile);
+    
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal;
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+    
+    Daemon daemon(parameters, bank);
+    daemon.run();
+    return EXIT_SUCCESS;
+  }
+  catch (boost::program_options::error& e) {
+    std::cerr << "Failed to parse options: " << e.what() << std::endl;
+    std::cerr << "Run with --help to see invocation synopsis." << std::endl;
+  }
+  catch (std::exception& e) {
+    std::cerr << "FATAL ERROR: " << e.what() << std::endl;
+  }
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,185 @@
+#define BOOST_TEST_MODULE testDaemonProtocol
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "../Client.hpp"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace bfs = boost::filesystem;
+using namespace cctag::daemon;
+
+namespace {
+
+const uint32_t FrameWidth = 320;
+const uint32_t FrameHeight = 240;
+
+// Runs cctagd (CCTAGD_PATH, set by the build) on its own socket and frame ring.
+class DaemonProcess
+{
+public:
+    DaemonProcess()
+        : _socketPath((bfs::temp_directory_path() / bfs::unique_path("cctagd-%%%%-%%%%.sock")).string())
+        , _ringName("/cctagd-test-" + std::to_string(::getpid()))
+    {
+        const std::string width = std::to_string(FrameWidth);
+        const std::string height = std::to_string(FrameHeight);
+        _pid = ::fork();
+        BOOST_REQUIRE(_pid >= 0);
+        if(_pid == 0)
+        {
+            ::execl(CCTAGD_PATH, CCTAGD_PATH, "--socket", _socketPath.c_str(), "--ring", _ringName.c_str(),
+                    "--slots", "4", "--max-width", width.c_str(), "--max-height", height.c_str(), (char*)nullptr);
+            ::_exit(127);
+        }
+    }
+
+    ~DaemonProcess()
+    {
+        if(_pid > 0)
+        {
+            ::kill(_pid, SIGTERM);
+            ::waitpid(_pid, nullptr, 0);
+        }
+    }
+
+    // Waits for the daemon to listen.
+    std::unique_ptr<Client> connect()
+    {
+        for(int attempt = 0; attempt < 100; ++attempt)
+        {
+            try
+            {
+                return std::unique_ptr<Client>(new Client(_socketPath));
+            }
+            catch(const std::runtime_error &)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+        BOOST_FAIL("cctagd did not start");
+        return nullptr;
+    }
+
+    bool running() const
+    {
+        return ::waitpid(_pid, nullptr, WNOHANG) == 0;
+    }
+
+    // Stops the daemon; returns its exit status.
+    int stop()
+    {
+        int status = -1;
+        ::kill(_pid, SIGTERM);
+        ::waitpid(_pid, &status, 0);
+        _pid = -1;
+        return status;
+    }
+
+private:
+    std::string _socketPath;
+    std::string _ringName;
+    pid_t _pid;
+};
+
+// Concentric dark and light rings on a textured background.
+void drawFrame(unsigned char* data)
+{
+    const float cx = FrameWidth / 2.f, cy = FrameHeight / 2.f;
+    for(uint32_t y = 0; y < FrameHeight; ++y)
+    for(uint32_t x = 0; x < FrameWidth; ++x)
+    {
+        const float r = std::hypot(x - cx, y - cy);
+        unsigned char v = 128 + ((x * 7 + y * 13) % 32);
+        if(r < 80.f)
+            v = (int(r / 13.f) % 2) ? 230 : 20;
+        data[y * FrameWidth + x] = v;
+    }
+}
+
+// Submits a frame of the given size and waits for its result.
+FrameResult submitAndWait(Client & client, uint64_t frameId, uint32_t width, uint32_t height, uint32_t stride)
+{
+    const int slot = client.acquire();
+    BOOST_REQUIRE(slot >= 0);
+    drawFrame(client.slotData(slot));
+    client.submit(slot, frameId, width, height, stride, FormatGray);
+
+    FrameResult result;
+    do
+    {
+        BOOST_REQUIRE(client.receive(result));
+    } while(result._clientId != client.clientId() || result._frameId != frameId);
+    return result;
+}
+
+void checkEqual(const FrameResult & a, const FrameResult & b)
+{
+    BOOST_CHECK_EQUAL(a._clientId, b._clientId);
+    BOOST_CHECK_EQUAL(a._frameId, b._frameId);
+    BOOST_CHECK_EQUAL(a._error, b._error);
+    BOOST_REQUIRE_EQUAL(a._markers.size(), b._markers.size());
+    for(std::size_t i = 0; i < a._markers.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(a._markers[i].id, b._markers[i].id);
+        BOOST_CHECK_EQUAL(a._markers[i].status, b._markers[i].status);
+        BOOST_CHECK_EQUAL(a._markers[i].x, b._markers[i].x);
+        BOOST_CHECK_EQUAL(a._markers[i].y, b._markers[i].y);
+        BOOST_CHECK_EQUAL(a._markers[i].quality, b._markers[i].quality);
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(test_daemonProtocol)
+
+BOOST_AUTO_TEST_CASE(test_subscriber_gets_submitter_result)
+{
+    DaemonProcess daemon;
+    std::unique_ptr<Client> subscriber = daemon.connect();
+    std::unique_ptr<Client> submitter = daemon.connect();
+    BOOST_CHECK_NE(subscriber->clientId(), submitter->clientId());
+
+    subscriber->subscribe();
+    // The daemon answers the messages of a connection in order: once the slot
+    // arrives, the subscription has been handled.
+    BOOST_REQUIRE(subscriber->acquire() >= 0);
+
+    const FrameResult submitted = submitAndWait(*submitter, 42, FrameWidth, FrameHeight, FrameWidth);
+    BOOST_CHECK(!submitted._error);
+
+    FrameResult received;
+    BOOST_REQUIRE(subscriber->receive(received));
+    checkEqual(received, submitted);
+
+    BOOST_CHECK_EQUAL(daemon.stop(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_bad_frames_are_reported)
+{
+    DaemonProcess daemon;
+    std::unique_ptr<Client> client = daemon.connect();
+
+    // stride smaller than the width: rejected
+    BOOST_CHECK(submitAndWait(*client, 1, FrameWidth, FrameHeight, FrameWidth / 2)._error);
+    // tiny frame, too small for the pyramid: rejected or detected, but answered
+    submitAndWait(*client, 2, 1, 1, 1);
+    BOOST_CHECK(daemon.running());
+
+    // the daemon still serves valid frames
+    BOOST_CHECK(!submitAndWait(*client, 3, FrameWidth, FrameHeight, FrameWidth)._error);
+    BOOST_CHECK_EQUAL(daemon.stop(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 #include <getopt.h>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include "CmdLine.hpp"
@@ -24,6 +25,17 @@ static const struct option longopts[] =
     {"bank",       required_argument, 0, 'b'},
     {"params",     required_argument, 0, 'p'},
     {"output",     optional_argument, 0, 'o'},   
+    {"timing",     no_argument,       0, 0xe0 },
+    {"perf-counters", no_argument,    0, 0xe1 },
+    {"record",     required_argument, 0, 0xe2 },
+    {"inflight",   required_argument, 0, 0xe3 },
+    {"latest-frame", no_argument,     0, 0xe4 },
+    {"headless",   no_argument,       0, 0xe5 },
+    {"loop",       required_argument, 0, 0xe6 },
+    {"workers",    required_argument, 0, 0xe7 },
+    {"results",    required_argument, 0, 0xe8 },
+    {"track",      required_argument, 0, 0xe9 },
+    {"budget",     required_argument, 0, 0xea },
 #ifdef CCTAG_WITH_CUDA
     {"sync",       no_argument,       0, 0xd0 },
     {"debug-dir",  required_argument, 0, 0xd1 },
@@ -39,6 +51,17 @@ CmdLine::CmdLine( )
     , _cctagBankFilename( "" )
     , _paramsFilename( "" )
     , _outputFolderName( "" )
+    , _timing( false )
+    , _perfCounters( false )
+    , _recordDir( "" )
+    , _inflight( 1 )
+    , _latestFrame( false )
+    , _headless( false )
+    , _loop( 1 )
+    , _workers( 2 )
+    , _resultsFilename( "" )
+    , _track( 0 )
+    , _budget( 0 )
 #ifdef CCTAG_WITH_CUDA
     , _switchSync( false )
     , _debugDir( "" )
@@ -70,6 +93,17 @@ bool CmdLine::parse( int argc, char* argv[] )
       case 'b'  : _cctagBankFilename = optarg; break;
       case 'p'  : _paramsFilename    = optarg; break;
       case 'o'  : _outputFolderName  = optarg; break;
+      case 0xe0 : _timing            = true;   break;
+      case 0xe1 : _perfCounters      = true; _timing = true; break;
+      case 0xe2 : _recordDir         = optarg; break;
+      case 0xe3 : _inflight          = strtol( optarg, NULL, 0 ); break;
+      case 0xe4 : _latestFrame       = true;   break;
+      case 0xe5 : _headless          = true;   break;
+      case 0xe6 : _loop              = strtol( optarg, NULL, 0 ); break;
+      case 0xe7 : _workers           = strtol( optarg, NULL, 0 ); break;
+      case 0xe8 : _resultsFilename   = optarg; break;
+      case 0xe9 : _track             = strtol( optarg, NULL, 0 ); break;
+      case 0xea : _budget            = strtof( optarg, NULL ); break;
 #ifdef CCTAG_WITH_CUDA
       case 0xd0 : _switchSync        = true;   break;
       case 0xd1 : _debugDir          = optarg; break;
@@ -90,6 +124,28 @@ void CmdLine::print( const char* const argv0 )
          << "    --bank      " << _cctagBankFilename << std::endl
          << "    --params    " << _paramsFilename << std::endl
          << "    --output    " << _outputFolderName << std::endl;
+    if( _timing )
+        std::cout << "    --timing " << std::endl;
+    if( _perfCounters )
+        std::cout << "    --perf-counters " << std::endl;
+    if( _recordDir != "" )
+        std::cout << "    --record " << _recordDir << std::endl;
+    if( _inflight != 1 )
+        std::cout << "    --inflight " << _inflight << std::endl;
+    if( _latestFrame )
+        std::cout << "    --latest-frame " << std::endl;
+    if( _headless )
+        std::cout << "    --headless " << std::endl;
+    if( _loop != 1 )
+        std::cout << "    --loop " << _loop << std::endl;
+    if( _workers != 2 )
+        std::cout << "    --workers " << _workers << std::endl;
+    if( _resultsFilename != "" )
+        std::cout << "    --results " << _resultsFilename << std::endl;
+    if( _track != 0 )
+        std::cout << "    --track " << _track << std::endl;
+    if( _budget > 0 )
+        std::cout << "    --budget " << _budget << std::endl;
 #ifdef CCTAG_WITH_CUDA
     if( _switchSync )
         std::cout << "    --sync " << std::endl;
@@ -111,6 +167,17 @@ void CmdLine::usage( const char* const argv0 )
           "           [-p|--params <confpath>]\n"
           "           [-b|--bank] <bankpath>\n"
           "           [-o|--output] <outputfoldername>\n"
+          "           [--timing]\n"
+          "           [--perf-counters]\n"
+          "           [--record <recorddir>]\n"
+          "           [--inflight <n>]\n"
+          "           [--latest-frame]\n"
+          "           [--headless]\n"
+          "           [--loop <n>]\n"
+          "           [--workers <n>]\n"
+          "           [--results <resultspath>]\n"
+          "           [--track <n>]\n"
+          "           [--budget <ms>]\n"
           "           [--sync]\n"
           "           [--debug-dir <debugdir>]\n"
           "           [--use-cuda]\n"
@@ -121,6 +188,20 @@ void CmdLine::usage( const char* const argv0 )
           "    <bankpath> - path to a bank parameter file, e.g. 4Crowns/ids.txt \n"
           "    <output>   - output folder name \n"
           "    <confpath> - path to configuration XML file \n"
+          "    --timing   - print the time spent in each detection stage\n"
+          "    --perf-counters - same as --timing, with hardware counters (Linux only)\n"
+          "    <recorddir> - store the state after voting and the identification cuts of every frame\n"
+          "    --inflight - video mode: overlap decoding, detection and display of up to <n> frames (default 1)\n"
+          "    --latest-frame - camera mode: always detect on the newest frame, dropping stale ones\n"
+          "    --headless - do not display results; print frames/s, latency percentiles and marker count\n"
+          "    --loop     - process the input <n> times (default 1)\n"
+          "    --workers  - directory mode: detect <n> images concurrently (default 2)\n"
+          "    <resultspath> - write the markers from a background thread, as JSON lines if\n"
+          "                    the name ends with .jsonl, in binary otherwise\n"
+          "    --track    - video and camera modes: re-localize the markers of the previous frame\n"
+          "                 around their position, with a full detection every <n> frames\n"
+          "    --budget   - stop detecting a frame after <ms> milliseconds and keep the markers\n"
+          "                 completed so far; not used by --track\n"
           "    --sync     - CUDA debug option, run all CUDA ops synchronously\n"
           "    <debugdir> - path storing image to debug intermediate GPU results\n"
           "    --use-cuda - select GPU code instead of CPU code\n"
@@ -19,6 +19,17 @@ public:
     std::string _paramsFilename;
     std::string _nCrowns;
     std::string _outputFolderName;
+    bool        _timing;
+    bool        _perfCounters;
+    std::string _recordDir;
+    int         _inflight;
+    bool        _latestFrame;
+    bool        _headless;
+    int         _loop;
+    int         _workers;
+    std::string _resultsFilename;
+    int         _track;
+    float       _budget;
 #ifdef CCTAG_WITH_CUDA
     bool        _switchSync;
     std::string _debugDir;
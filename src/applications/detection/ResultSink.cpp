@@ -0,0 +1,188 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "ResultSink.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+
+namespace cctag {
+
+namespace {
+
+// JSON has no NaN nor infinity: those are written as null.
+struct JsonFloat
+{
+  float _value;
+};
+
+std::ostream & operator<<(std::ostream & os, JsonFloat f)
+{
+  if(std::isfinite(f._value))
+    return os << f._value;
+  return os << "null";
+}
+
+} // namespace
+
+ResultSink::ResultSink(const std::string & filename)
+  : _queue(256)
+  , _closing(false)
+  , _buffer(1 << 20)
+{
+  // large buffer: the writer thread flushes rarely
+  _file.rdbuf()->pubsetbuf(_buffer.data(), _buffer.size());
+  _file.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+  if(!_file)
+    throw std::runtime_error("ResultSink: cannot open " + filename);
+}
+
+ResultSink::~ResultSink()
+{
+  // derived classes close in their destructor; this only catches an
+  // exception thrown before start()
+  if(_writer.joinable())
+  {
+    _closing = true;
+    _writer.join();
+  }
+}
+
+void ResultSink::start()
+{
+  _writer = std::thread(&ResultSink::run, this);
+}
+
+void ResultSink::push(std::size_t frameId, const boost::ptr_list<CCTag> & markers, bool truncated)
+{
+  std::unique_ptr<FrameRecord> frame(new FrameRecord);
+  frame->_frameId = frameId;
+  frame->_truncated = truncated;
+  frame->_markers.reserve(markers.size());
+  for(const CCTag & marker : markers)
+  {
+    const auto & ellipse = marker.rescaledOuterEllipse();
+    MarkerRecord record;
+    record._id = marker.id();
+    record._status = marker.getStatus();
+    record._x = marker.x();
+    record._y = marker.y();
+    record._quality = marker.quality();
+    record._ellipseCx = ellipse.center().x();
+    record._ellipseCy = ellipse.center().y();
+    record._ellipseA = ellipse.a();
+    record._ellipseB = ellipse.b();
+    record._ellipseAngle = ellipse.angle();
+    frame->_markers.push_back(record);
+  }
+  // never fails: the queue allocates a node when its free list is empty
+  _queue.push(frame.release());
+}
+
+void ResultSink::close()
+{
+  if(!_writer.joinable())
+    return;
+  _closing = true;
+  _writer.join();
+  _file.flush();
+}
+
+void ResultSink::run()
+{
+  while(true)
+  {
+    // read the flag before draining, so that no frame pushed before close()
+    // is left in the queue
+    const bool closing = _closing;
+    FrameRecord* frame;
+    bool idle = true;
+    while(_queue.pop(frame))
+    {
+      std::unique_ptr<FrameRecord> owner(frame);
+      write(*frame);
+      idle = false;
+    }
+    if(closing)
+      break;
+    if(idle)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+std::unique_ptr<ResultSink> ResultSink::create(const std::string & filename)
+{
+  const std::string ext = ".jsonl";
+  if(filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0)
+    return std::unique_ptr<ResultSink>(new JsonResultSink(filename));
+  return std::unique_ptr<ResultSink>(new BinaryResultSink(filename));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+BinaryResultSink::BinaryResultSink(const std::string & filename)
+  : ResultSink(filename)
+{
+  _file.write("CCTAGRES", 8);
+  const uint32_t version = Version;
+  _file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+  start();
+}
+
+BinaryResultSink::~BinaryResultSink()
+{
+  close();
+}
+
+void BinaryResultSink::write(const FrameRecord & frame)
+{
+  const uint32_t count = frame._markers.size();
+  const uint32_t flags = frame._truncated ? TruncatedFlag : 0;
+  _file.write(reinterpret_cast<const char*>(&frame._frameId), sizeof(frame._frameId));
+  _file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  _file.write(reinterpret_cast<const char*>(&flags), sizeof(flags));
+  _file.write(reinterpret_cast<const char*>(frame._markers.data()), count * sizeof(MarkerRecord));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+JsonResultSink::JsonResultSink(const std::string & filename)
+  : ResultSink(filename)
+{
+  // enough digits for the floats to read back unchanged
+  _file << std::setprecision(std::numeric_limits<float>::max_digits10);
+  start();
+}
+
+JsonResultSink::~JsonResultSink()
+{
+  close();
+}
+
+void JsonResultSink::write(const FrameRecord & frame)
+{
+  _file << "{\"frame\":" << frame._frameId << ",\"truncated\":" << (frame._truncated ? "true" : "false")
+        << ",\"markers\":[";
+  for(std::size_t i = 0; i < frame._markers.size(); ++i)
+  {
+    const MarkerRecord & m = frame._markers[i];
+    if(i)
+      _file << ',';
+    _file << "{\"id\":" << m._id << ",\"status\":" << m._status
+          << ",\"x\":" << JsonFloat{m._x} << ",\"y\":" << JsonFloat{m._y}
+          << ",\"quality\":" << JsonFloat{m._quality}
+          << ",\"ellipse\":[" << JsonFloat{m._ellipseCx} << ',' << JsonFloat{m._ellipseCy}
+          << ',' << JsonFloat{m._ellipseA} << ',' << JsonFloat{m._ellipseB}
+          << ',' << JsonFloat{m._ellipseAngle} << "]}";
+  }
+  _file << "]}\n";
+}
+
+} // namespace cctag
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include "cctag/CCTag.hpp"
+
+#include <boost/lockfree/queue.hpp>
+#include <boost/ptr_container/ptr_list.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cctag {
+
+/**
+ * @brief One detected marker, as stored by the result sinks. The ellipse is
+ * the outer ellipse in image coordinates.
+ */
+struct MarkerRecord
+{
+  int32_t _id;
+  int32_t _status;
+  float   _x;
+  float   _y;
+  float   _quality;
+  float   _ellipseCx;
+  float   _ellipseCy;
+  float   _ellipseA;
+  float   _ellipseB;
+  float   _ellipseAngle;
+};
+
+/**
+ * @brief The markers detected in one frame.
+ */
+struct FrameRecord
+{
+  uint64_t _frameId;
+  bool _truncated;    // the detection was cut short by the time budget
+  std::vector<MarkerRecord> _markers;
+};
+
+/**
+ * @brief Asynchronous writer of detection results. push() only copies the
+ * markers and enqueues them on a lock-free queue, so detection threads never
+ * wait for I/O; a background thread formats and writes the frames in the
+ * order they were pushed.
+ */
+class ResultSink
+{
+public:
+  virtual ~ResultSink();
+
+  /**
+   * @brief Queue the markers of a frame for writing. Thread-safe, but the
+   * frames are written in the order they are pushed.
+   */
+  void push(std::size_t frameId, const boost::ptr_list<CCTag> & markers, bool truncated = false);
+
+  /**
+   * @brief Write all pending frames and stop the writer thread.
+   */
+  void close();
+
+  /**
+   * @brief Create the sink matching the file extension: JSONL for ".jsonl",
+   * binary otherwise.
+   */
+  static std::unique_ptr<ResultSink> create(const std::string & filename);
+
+protected:
+  explicit ResultSink(const std::string & filename);
+
+  // Must be called by the derived constructors, once the object is complete.
+  void start();
+
+  virtual void write(const FrameRecord & frame) = 0;
+
+  std::ofstream _file;
+
+private:
+  void run();
+
+  boost::lockfree::queue<FrameRecord*> _queue;
+  std::atomic<bool> _closing;
+  std::thread _writer;
+  std::vector<char> _buffer;
+};
+
+/**
+ * @brief Compact binary results. The file starts with the 8 bytes "CCTAGRES"
+ * and a uint32 version; each frame is a uint64 frame id, a uint32 marker count,
+ * uint32 flags and that many MarkerRecord, all in native byte order. Flag bit 0
+ * is set if the detection was truncated by the time budget (version 2).
+ */
+class BinaryResultSink : public ResultSink
+{
+public:
+  static const uint32_t Version = 2;
+  static const uint32_t TruncatedFlag = 1;
+
+  explicit BinaryResultSink(const std::string & filename);
+  ~BinaryResultSink() override;
+
+protected:
+  void write(const FrameRecord & frame) override;
+};
+
+/**
+ * @brief One JSON object per frame and line:
+ * {"frame":F,"truncated":false,"markers":[{"id":..,"status":..,"x":..,"y":..,"quality":..,"ellipse":[cx,cy,a,b,angle]},...]}
+ * The floats are written with max_digits10 digits, and as null when not finite.
+ */
+class JsonResultSink : public ResultSink
+{
+public:
+  explicit JsonResultSink(const std::string & filename);
+  ~JsonResultSink() override;
+
+protected:
+  void write(const FrameRecord & frame) override;
+};
+
+} // namespace cctag
@@ -9,7 +9,9 @@
 #include "cctag/utils/VisualDebug.hpp"
 #include "cctag/utils/Exceptions.hpp"
 #include "cctag/Detection.hpp"
+#include "cctag/Tracking.hpp"
 #include "CmdLine.hpp"
+#include "ResultSink.hpp"
 
 #ifdef CCTAG_WITH_CUDA
 #include "cctag/cuda/device_prop.hpp"
@@ -41,6 +43,15 @@
 #include <string>
 #include <fstream>
 #include <exception>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
 
 #include <tbb/tbb.h>
 
@@ -51,6 +62,68 @@ using boost::timer;
 
 namespace bfs = boost::filesystem;
 
+// Stage-timing report, enabled with --timing. Not thread-safe: only used
+// when frames are processed sequentially.
+static cctag::logtime::Mgmt* durations = nullptr;
+
+/**
+ * @brief Per-frame latencies and marker counts of a benchmark run (--headless).
+ */
+class BenchmarkStats
+{
+public:
+  void add(double latency, std::size_t nMarkers, bool truncated)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _latencies.push_back(latency);
+    _markers += nMarkers;
+    if(truncated)
+      ++_truncated;
+  }
+
+  /**
+   * @brief Print the throughput and the latency distribution.
+   *
+   * @param[out] os The stream to print to.
+   * @param[in] seconds The wall time of the whole run.
+   */
+  void print(std::ostream & os, double seconds)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::sort(_latencies.begin(), _latencies.end());
+    const std::size_t n = _latencies.size();
+    // nearest-rank percentile
+    auto percentile = [&](double p) {
+      return n ? _latencies[std::min(n - 1, std::size_t(std::ceil(p * n)) - 1)] : 0.0;
+    };
+    os << "Benchmark: " << n << " frames in " << seconds << " s, " << (seconds > 0 ? n / seconds : 0.0) << " frames/s\n"
+       << "  latency (ms): p50=" << percentile(0.5) << " p90=" << percentile(0.9)
+       << " p99=" << percentile(0.99) << " max=" << (n ? _latencies.back() : 0.0) << "\n"
+       << "  markers detected and identified: " << _markers << std::endl;
+    if(_truncated)
+      os << "  frames truncated by the time budget: " << _truncated << std::endl;
+  }
+
+private:
+  std::mutex _mutex;
+  std::vector<double> _latencies;  // in milliseconds
+  std::size_t _markers = 0;
+  std::size_t _truncated = 0;
+};
+
+// Enabled with --headless, thread-safe.
+static BenchmarkStats* benchmark = nullptr;
+
+// Enabled with --results, thread-safe. Replaces the text output of the markers.
+static cctag::ResultSink* resultSink = nullptr;
+
+// Enabled with --track in video and camera modes. Not thread-safe: the frames
+// are then detected one at a time, in order.
+static cctag::MarkerTracker* tracker = nullptr;
+
+// Time budget of a frame in milliseconds, set with --budget; 0 for none.
+static float budget = 0.f;
+
 /**
  * @brief Check if a string is an integer number.
  * 
@@ -105,8 +178,12 @@ void drawMarkers(const boost::ptr_list<CCTag> &markers, cv::Mat &image)
  * @param[out] outStream The output stream on which to write debug information.
  * @param[out] debugFileName The filename for the image to save with the detected 
  * markers.
+ * @return true if the detection was truncated by the time budget.
+ *
+ * The markers are not written to the result sink, which must receive the
+ * frames in order: the caller passes them to pushResults.
  */
-void detection(std::size_t frameId,
+bool detection(std::size_t frameId,
                int pipeId,
                const cv::Mat & src,
                const cctag::Parameters & params,
@@ -123,15 +200,27 @@ void detection(std::size_t frameId,
 
   // Process markers detection
   boost::timer t;
+  const auto t0 = std::chrono::steady_clock::now();
 
   CCTagVisualDebug::instance().initBackgroundImage(src);
   CCTagVisualDebug::instance().setImageFileName(debugFileName);
   CCTagFileDebug::instance().setPath(CCTagVisualDebug::instance().getPath());
 
-  static cctag::logtime::Mgmt* durations = nullptr;
+  if(durations)
+  {
+    durations->resetStartTime();
+  }
 
   //Call the main CCTag detection function
-  cctagDetection(markers, pipeId, frameId, src, params, bank, true, durations);
+  std::unique_ptr<cctag::Deadline> deadline;
+  if(budget > 0 && !tracker)
+    deadline.reset(new cctag::Deadline(std::chrono::microseconds(std::int64_t(budget * 1000))));
+  if(tracker)
+    tracker->track(markers, frameId, src, durations);
+  else
+    cctagDetection(markers, pipeId, frameId, src, params, bank, true, durations, nullptr, deadline.get());
+  const auto t1 = std::chrono::steady_clock::now();
+  const bool truncated = deadline && deadline->truncated();
 
   if(durations)
   {
@@ -148,12 +237,18 @@ void detection(std::size_t frameId,
 
   std::size_t counter = 0;
   std::size_t nMarkers = 0;
-  outStream << "#frame " << frameId << '\n';
-  outStream << "Detected " << markers.size() << " candidates" << '\n';
+  if(!resultSink)
+  {
+    outStream << "#frame " << frameId << '\n';
+    outStream << "Detected " << markers.size() << " candidates" << '\n';
+    if(truncated)
+      outStream << "Truncated by the time budget" << '\n';
+  }
 
   for(const cctag::CCTag & marker : markers)
   {
-    outStream << marker.x() << " " << marker.y() << " " << marker.id() << " " << marker.getStatus() << '\n';
+    if(!resultSink)
+      outStream << marker.x() << " " << marker.y() << " " << marker.id() << " " << marker.getStatus() << '\n';
     ++counter;
     if(marker.getStatus() == status::id_reliable)
       ++nMarkers;
@@ -174,6 +269,378 @@ void detection(std::size_t frameId,
   }
 
   std::cout << std::endl << nMarkers << " markers detected and identified" << std::endl;
+
+  if(benchmark)
+  {
+    benchmark->add(std::chrono::duration<double, std::milli>(t1 - t0).count(), nMarkers, truncated);
+  }
+  return truncated;
+}
+
+/**
+ * @brief Write the markers of a frame to the result sink, if any. Must be
+ * called in frame order.
+ */
+void pushResults(std::size_t frameId, const boost::ptr_list<CCTag> & markers, bool truncated)
+{
+  if(resultSink)
+    resultSink->push(frameId, markers, truncated);
+}
+
+/**
+ * @brief Show the frame with the detected markers and handle the keyboard:
+ * ESC stops, 'd' switches to debug mode (wait for a key after each frame),
+ * 'l' back to live mode.
+ *
+ * @param[in] windowName The window to draw into.
+ * @param[in,out] frame The original frame, markers are drawn into it.
+ * @param[in] gray The grayscale frame.
+ * @param[in] markers The detected markers.
+ * @param[in,out] delay Time to wait in milliseconds for keyboard input.
+ * @return false if the user asked to stop.
+ */
+bool displayMarkers(const std::string & windowName,
+                    cv::Mat & frame,
+                    const cv::Mat & gray,
+                    const boost::ptr_list<CCTag> & markers,
+                    int & delay)
+{
+  // if the original image is b/w convert it to BGRA so we can draw colors
+  if(frame.channels() == 1)
+    cv::cvtColor(gray, frame, cv::COLOR_GRAY2BGRA);
+
+  drawMarkers(markers, frame);
+  cv::imshow(windowName, frame);
+  if( cv::waitKey(delay) == 27 ) return false;
+  char key = (char) cv::waitKey(delay);
+  // stop capturing by pressing ESC
+  if(key == 27)
+    return false;
+  if(key == 'l' || key == 'L')
+    delay = 10;
+  // delay = 0 will wait for a key to be pressed
+  if(key == 'd' || key == 'D')
+    delay = 0;
+  return true;
+}
+
+/**
+ * @brief A video frame travelling through the video pipeline.
+ */
+struct VideoFrame
+{
+  std::size_t _frameId;
+  cv::Mat _frame;
+  cv::Mat _gray;
+  boost::ptr_list<CCTag> _markers;
+  bool _truncated = false;
+  std::ostringstream _output;     // written to the output stream in frame order
+};
+
+/**
+ * @brief Process a video or camera stream as a pipeline: decoding, grayscale
+ * conversion, detection and display of up to inflight frames overlap. Decoding
+ * and display are serial and in frame order, while conversion and detection
+ * run concurrently, each detection with its own pipe id. The detection results
+ * are written to outStream in frame order.
+ *
+ * @param[in] video The opened video stream.
+ * @param[in] inflight The maximum number of frames in the pipeline.
+ * @param[in] headless Do not display the results.
+ * @param[in] params The parameters for the detection.
+ * @param[in] bank The marker bank.
+ * @param[out] outStream The output stream on which to write debug information.
+ * @return false if the user asked to stop.
+ */
+bool processVideo(cv::VideoCapture & video,
+                  int inflight,
+                  bool headless,
+                  const cctag::Parameters & params,
+                  const cctag::CCTagMarkersBank & bank,
+                  std::ostream & outStream)
+{
+  const std::string windowName = "Detection result";
+  if(!headless)
+    cv::namedWindow(windowName, cv::WINDOW_NORMAL);
+
+  // pipe ids of the detectors that are not busy
+  tbb::concurrent_bounded_queue<int> idleDetectors;
+  for(int pipeId = 0; pipeId < inflight; ++pipeId)
+    idleDetectors.push(pipeId);
+
+  std::size_t frameId = 0;
+  std::atomic<bool> stop(false);
+
+  // time to wait in milliseconds for keyboard input, used to switch from
+  // live to debug mode
+  int delay = 10;
+
+  auto decode = tbb::make_filter<void, VideoFrame*>(tbb::filter::serial_in_order,
+    [&](tbb::flow_control & fc) -> VideoFrame*
+    {
+      std::unique_ptr<VideoFrame> vf(new VideoFrame);
+      if(!stop)
+        video >> vf->_frame;
+      if(stop || vf->_frame.empty())
+      {
+        fc.stop();
+        return nullptr;
+      }
+      vf->_frameId = frameId++;
+      return vf.release();
+    });
+
+  auto convert = tbb::make_filter<VideoFrame*, VideoFrame*>(tbb::filter::parallel,
+    [](VideoFrame* vf) -> VideoFrame*
+    {
+      if(vf->_frame.channels() == 3 || vf->_frame.channels() == 4)
+        cv::cvtColor(vf->_frame, vf->_gray, cv::COLOR_BGR2GRAY);
+      else
+        vf->_frame.copyTo(vf->_gray);
+      return vf;
+    });
+
+  auto detect = tbb::make_filter<VideoFrame*, VideoFrame*>(tbb::filter::parallel,
+    [&](VideoFrame* vf) -> VideoFrame*
+    {
+      // Set the output folder
+      std::stringstream outFileName;
+      outFileName << std::setfill('0') << std::setw(5) << vf->_frameId;
+
+      int pipeId;
+      idleDetectors.pop(pipeId);
+      vf->_truncated = detection(vf->_frameId, pipeId, vf->_gray, params, bank, vf->_markers, vf->_output, outFileName.str());
+      idleDetectors.push(pipeId);
+      return vf;
+    });
+
+  auto display = tbb::make_filter<VideoFrame*, void>(tbb::filter::serial_in_order,
+    [&](VideoFrame* vf)
+    {
+      std::unique_ptr<VideoFrame> owner(vf);
+      outStream << vf->_output.str();
+      pushResults(vf->_frameId, vf->_markers, vf->_truncated);
+      if(!headless && !stop && !displayMarkers(windowName, vf->_frame, vf->_gray, vf->_markers, delay))
+        stop = true;
+    });
+
+  tbb::parallel_pipeline(inflight, decode & convert & detect & display);
+  return !stop;
+}
+
+/**
+ * @brief Process the images of a directory with a pool of workers. Each
+ * worker owns a detector (pipe id) and takes the next image from a shared
+ * queue, so that cheap and expensive images balance out; images are read
+ * and converted ahead of detection, and the results are written to outStream
+ * in input order.
+ *
+ * @param[in] files The image files, in processing order.
+ * @param[in] workers The number of concurrent detections.
+ * @param[in] params The parameters for the detection.
+ * @param[in] bank The marker bank.
+ * @param[out] outStream The output stream on which to write debug information.
+ */
+void processDirectory(const std::vector<bfs::path> & files,
+                      int workers,
+                      const cctag::Parameters & params,
+                      const cctag::CCTagMarkersBank & bank,
+                      std::ostream & outStream)
+{
+  struct ImageFrame
+  {
+    std::size_t _frameId;
+    bfs::path _path;
+    cv::Mat _gray;
+    boost::ptr_list<CCTag> _markers;
+    bool _truncated = false;
+    std::ostringstream _output;
+  };
+
+  // pipe ids of the detectors that are not busy
+  tbb::concurrent_bounded_queue<int> idleDetectors;
+  for(int pipeId = 0; pipeId < workers; ++pipeId)
+    idleDetectors.push(pipeId);
+
+  std::size_t frameId = 0;
+
+  auto next = tbb::make_filter<void, ImageFrame*>(tbb::filter::serial_in_order,
+    [&](tbb::flow_control & fc) -> ImageFrame*
+    {
+      if(frameId == files.size())
+      {
+        fc.stop();
+        return nullptr;
+      }
+      ImageFrame* frame = new ImageFrame;
+      frame->_frameId = frameId;
+      frame->_path = files[frameId++];
+      return frame;
+    });
+
+  auto load = tbb::make_filter<ImageFrame*, ImageFrame*>(tbb::filter::parallel,
+    [](ImageFrame* frame) -> ImageFrame*
+    {
+      cv::Mat src = cv::imread(frame->_path.string());
+      if(!src.empty())
+        cv::cvtColor(src, frame->_gray, CV_BGR2GRAY);
+      return frame;
+    });
+
+  auto detect = tbb::make_filter<ImageFrame*, ImageFrame*>(tbb::filter::parallel,
+    [&](ImageFrame* frame) -> ImageFrame*
+    {
+      if(frame->_gray.empty())
+        return frame;
+      int pipeId;
+      idleDetectors.pop(pipeId);
+      frame->_truncated = detection(frame->_frameId, pipeId, frame->_gray, params, bank, frame->_markers, frame->_output, frame->_path.stem().string());
+      idleDetectors.push(pipeId);
+      return frame;
+    });
+
+  auto output = tbb::make_filter<ImageFrame*, void>(tbb::filter::serial_in_order,
+    [&](ImageFrame* frame)
+    {
+      std::unique_ptr<ImageFrame> owner(frame);
+      if(frame->_gray.empty())
+      {
+        std::cerr << "Could not read image " << frame->_path.string() << std::endl;
+        return;
+      }
+      outStream << frame->_output.str();
+      pushResults(frame->_frameId, frame->_markers, frame->_truncated);
+      std::cerr << "Done processing image " << frame->_path.string() << std::endl;
+    });
+
+  // two images in flight per worker, so that the next one is decoded while
+  // the current one is being detected
+  tbb::parallel_pipeline(2 * workers, next & load & detect & output);
+}
+
+/**
+ * @brief Process a live camera, keeping latency bounded rather than processing
+ * every frame. A capture thread keeps reading the camera so that no backlog
+ * builds up in the driver, and only keeps the newest frame; the detection loop
+ * always takes the newest frame and frames captured in between are dropped.
+ * Once per second, the processed and dropped frame rates and the
+ * capture-to-result latency are printed on std::cerr.
+ *
+ * @param[in] video The opened camera.
+ * @param[in] headless Do not display the results.
+ * @param[in] params The parameters for the detection.
+ * @param[in] bank The marker bank.
+ * @param[out] outStream The output stream on which to write debug information.
+ */
+void processCameraLatest(cv::VideoCapture & video,
+                         bool headless,
+                         const cctag::Parameters & params,
+                         const cctag::CCTagMarkersBank & bank,
+                         std::ostream & outStream)
+{
+  using clock = std::chrono::steady_clock;
+
+  const std::string windowName = "Detection result";
+  if(!headless)
+    cv::namedWindow(windowName, cv::WINDOW_NORMAL);
+
+  // newest captured frame, protected by mutex
+  std::mutex mutex;
+  std::condition_variable captured;
+  cv::Mat latest;
+  clock::time_point latestTime;
+  std::size_t latestId = 0;       // number of frames captured so far
+  bool capturing = true;
+
+  std::thread captureThread([&]()
+  {
+    while(true)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!capturing)
+          break;
+      }
+      cv::Mat frame;
+      video >> frame;
+      std::lock_guard<std::mutex> lock(mutex);
+      if(frame.empty())
+        capturing = false;
+      else
+      {
+        latest = frame;
+        latestTime = clock::now();
+        ++latestId;
+      }
+      captured.notify_one();
+    }
+  });
+
+  std::size_t processedId = 0;    // id of the last processed frame
+  int delay = 10;
+
+  // statistics of the current reporting period
+  clock::time_point periodStart = clock::now();
+  std::size_t periodFrames = 0, periodDropped = 0;
+  double periodLatencySum = 0, periodLatencyMax = 0;
+
+  while(true)
+  {
+    cv::Mat frame;
+    clock::time_point captureTime;
+    std::size_t frameId;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      captured.wait(lock, [&]() { return !capturing || latestId != processedId; });
+      if(latestId == processedId)
+        break;
+      frame = latest;
+      captureTime = latestTime;
+      frameId = latestId - 1;
+      periodDropped += latestId - processedId - 1;
+      processedId = latestId;
+    }
+
+    cv::Mat imgGray;
+    if(frame.channels() == 3 || frame.channels() == 4)
+      cv::cvtColor(frame, imgGray, cv::COLOR_BGR2GRAY);
+    else
+      frame.copyTo(imgGray);
+
+    std::stringstream outFileName;
+    outFileName << std::setfill('0') << std::setw(5) << frameId;
+
+    boost::ptr_list<CCTag> markers;
+    const int pipeId = 0;
+    const bool truncated = detection(frameId, pipeId, imgGray, params, bank, markers, outStream, outFileName.str());
+    pushResults(frameId, markers, truncated);
+
+    const clock::time_point resultTime = clock::now();
+    const double latency = std::chrono::duration<double, std::milli>(resultTime - captureTime).count();
+    ++periodFrames;
+    periodLatencySum += latency;
+    periodLatencyMax = std::max(periodLatencyMax, latency);
+
+    const double period = std::chrono::duration<double>(resultTime - periodStart).count();
+    if(period >= 1.0)
+    {
+      std::cerr << "Camera: " << periodFrames / period << " frames/s processed, "
+                << periodDropped / period << " frames/s dropped, latency mean "
+                << periodLatencySum / periodFrames << " ms, max " << periodLatencyMax << " ms" << std::endl;
+      periodStart = resultTime;
+      periodFrames = periodDropped = 0;
+      periodLatencySum = periodLatencyMax = 0;
+    }
+
+    if(!headless && !displayMarkers(windowName, frame, imgGray, markers, delay))
+      break;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    capturing = false;
+  }
+  captureThread.join();
 }
 
 /*************************************************************/
@@ -220,6 +687,32 @@ int main(int argc, char** argv)
   cctag::pop_cuda_only_sync_calls(cmdline._switchSync);
 #endif
 
+  std::unique_ptr<cctag::logtime::Mgmt> timingReport;
+  if(cmdline._timing)
+  {
+    timingReport.reset(new cctag::logtime::Mgmt(200, cmdline._perfCounters));
+    if(cmdline._perfCounters && !timingReport->hasHardwareCounters())
+      std::cerr << "Hardware counters are not available, reporting wall time only" << std::endl;
+    durations = timingReport.get();
+  }
+
+  BenchmarkStats benchmarkStats;
+  if(cmdline._headless)
+  {
+    benchmark = &benchmarkStats;
+  }
+  budget = cmdline._budget;
+
+  // number of passes over the input, to benchmark short inputs
+  const int loops = std::max(cmdline._loop, 1);
+
+  std::unique_ptr<cctag::ResultSink> results;
+  if(!cmdline._resultsFilename.empty())
+  {
+    results = cctag::ResultSink::create(cmdline._resultsFilename);
+    resultSink = results.get();
+  }
+
   // Check the (optional) parameters path
   const std::size_t nCrowns = std::atoi(cmdline._nCrowns.c_str());
   cctag::Parameters params(nCrowns);
@@ -258,6 +751,12 @@ int main(int argc, char** argv)
     CCTAG_COUT("Parameter file not provided. Default parameters are used.");
   }
 
+  if(!cmdline._recordDir.empty())
+  {
+    bfs::create_directories(cmdline._recordDir);
+    params._recordDir = cmdline._recordDir;
+  }
+
   CCTagMarkersBank bank(params._nCrowns);
   if(!cmdline._cctagBankFilename.empty())
   {
@@ -301,6 +800,8 @@ int main(int argc, char** argv)
   std::ofstream outputFile;
   outputFile.open(outputFileName);
 
+  const auto startTime = std::chrono::steady_clock::now();
+
 #if USE_DEVIL
   if( (ext == ".bmp") ||
       (ext == ".gif") ||
@@ -335,12 +836,16 @@ int main(int argc, char** argv)
     imwrite( "ballo.jpg", graySrc );
 
     const int pipeId = 0;
-    boost::ptr_list<CCTag> markers;
+    for(int pass = 0; pass < loops; ++pass)
+    {
+      boost::ptr_list<CCTag> markers;
 #ifdef PRINT_TO_CERR
-    detection(0, pipeId, graySrc, params, bank, markers, std::cerr, myPath.stem().string());
+      const bool truncated = detection(0, pipeId, graySrc, params, bank, markers, std::cerr, myPath.stem().string());
 #else // PRINT_TO_CERR
-    detection(0, pipeId, graySrc, params, bank, markers, outputFile, myPath.stem().string());
+      const bool truncated = detection(0, pipeId, graySrc, params, bank, markers, outputFile, myPath.stem().string());
 #endif // PRINT_TO_CERR
+      pushResults(0, markers, truncated);
+    }
   }
 #else // USE_DEVIL
   if((ext == ".png") || (ext == ".jpg"))
@@ -356,12 +861,16 @@ int main(int argc, char** argv)
     cv::cvtColor(src, graySrc, CV_BGR2GRAY);
 
     const int pipeId = 0;
-    boost::ptr_list<CCTag> markers;
+    for(int pass = 0; pass < loops; ++pass)
+    {
+      boost::ptr_list<CCTag> markers;
 #ifdef PRINT_TO_CERR
-    detection(0, pipeId, graySrc, params, bank, markers, std::cerr, myPath.stem().string());
+      const bool truncated = detection(0, pipeId, graySrc, params, bank, markers, std::cerr, myPath.stem().string());
 #else // PRINT_TO_CERR
-    detection(0, pipeId, graySrc, params, bank, markers, outputFile, myPath.stem().string());
+      const bool truncated = detection(0, pipeId, graySrc, params, bank, markers, outputFile, myPath.stem().string());
 #endif // PRINT_TO_CERR
+      pushResults(0, markers, truncated);
+    }
   }
 #endif // USE_DEVIL
   else if(ext == ".avi" || ext == ".mov" || useCamera)
@@ -382,68 +891,50 @@ int main(int argc, char** argv)
       return EXIT_FAILURE;
     }
 
-    const std::string windowName = "Detection result";
-    cv::namedWindow(windowName, cv::WINDOW_NORMAL);
-
-    std::cerr << "Starting to read video frames" << std::endl;
-    std::size_t frameId = 0;
-    
-    // time to wait in milliseconds for keyboard input, used to switch from
-    // live to debug mode
-    int delay = 10;
-
-    while(true)
+    std::unique_ptr<cctag::MarkerTracker> markerTracker;
+    if(cmdline._track > 0)
     {
-      cv::Mat frame;
-      video >> frame;
-      if(frame.empty())
-        break;
-      
-      cv::Mat imgGray;
-
-      if(frame.channels() == 3 || frame.channels() == 4)
-        cv::cvtColor(frame, imgGray, cv::COLOR_BGR2GRAY);
-      else
-        frame.copyTo(imgGray);
-
-      // Set the output folder
-      std::stringstream outFileName;
-      outFileName << std::setfill('0') << std::setw(5) << frameId;
-      
-      boost::ptr_list<CCTag> markers;
-
-      // Invert the image for the projection scenario
-      //cv::Mat imgGrayInverted;
-      //bitwise_not ( imgGray, imgGrayInverted );
+      markerTracker.reset(new cctag::MarkerTracker(params, bank, cmdline._track));
+      tracker = markerTracker.get();
+    }
 
-      // Call the CCTag detection
-      const int pipeId = 0;
+    if(useCamera && cmdline._latestFrame)
+    {
+      std::cerr << "Starting to read camera frames, newest frame first" << std::endl;
 #ifdef PRINT_TO_CERR
-      detection(frameId, pipeId, imgGray, params, bank, markers, std::cerr, outFileName.str());
+      processCameraLatest(video, cmdline._headless, params, bank, std::cerr);
 #else
-      detection(frameId, pipeId, imgGray, params, bank, markers, outputFile, outFileName.str());
+      processCameraLatest(video, cmdline._headless, params, bank, outputFile);
 #endif
-      
-      // if the original image is b/w convert it to BGRA so we can draw colors
-      if(frame.channels() == 1)
-        cv::cvtColor(imgGray, frame, cv::COLOR_GRAY2BGRA);
-      
-      drawMarkers(markers, frame);
-      cv::imshow(windowName, frame);
-      if( cv::waitKey(delay) == 27 ) break;
-      char key = (char) cv::waitKey(delay);
-      // stop capturing by pressing ESC
-      if(key == 27) 
-        break;
-      if(key == 'l' || key == 'L')
-        delay = 10;
-      // delay = 0 will wait for a key to be pressed
-      if(key == 'd' || key == 'D')
-        delay = 0;
-      
-      ++frameId;
     }
+    else
+    {
+      // tracking needs the markers of the previous frame
+      const int inflight = tracker ? 1 : std::max(cmdline._inflight, 1);
+      if(inflight > 1 && durations)
+      {
+        // frames are detected concurrently
+        std::cerr << "The timing report needs sequential detection, ignoring --timing with --inflight " << inflight << std::endl;
+        durations = nullptr;
+      }
 
+      std::cerr << "Starting to read video frames" << std::endl;
+      for(int pass = 0; pass < loops; ++pass)
+      {
+        // a camera cannot be rewound, but never ends either
+        if(pass > 0 && (useCamera || !video.open(cmdline._filename)))
+          break;
+        if(tracker)
+          tracker->reset();
+#ifdef PRINT_TO_CERR
+        if(!processVideo(video, inflight, cmdline._headless, params, bank, std::cerr))
+          break;
+#else
+        if(!processVideo(video, inflight, cmdline._headless, params, bank, outputFile))
+          break;
+#endif
+      }
+    }
   }
   else if(bfs::is_directory(myPath))
   {
@@ -454,50 +945,49 @@ int main(int argc, char** argv)
     std::copy(bfs::directory_iterator(myPath), bfs::directory_iterator(), std::back_inserter(vFileInFolder)); // is directory_entry, which is
     std::sort(vFileInFolder.begin(), vFileInFolder.end());
 
-    std::size_t frameId = 0;
-
-    std::map<int, bfs::path> files[2];
+    std::vector<bfs::path> images;
     for(const auto & fileInFolder : vFileInFolder)
     {
-      files[frameId & 1].insert(std::pair<int, bfs::path>(frameId, fileInFolder));
-      frameId++;
+      std::string subExt(bfs::extension(fileInFolder));
+      boost::algorithm::to_lower(subExt);
+      if((subExt == ".png") || (subExt == ".jpg"))
+        images.push_back(fileInFolder);
     }
 
-    tbb::parallel_for(0, 2, [&](size_t fileListIdx)
+    const int workers = std::max(cmdline._workers, 1);
+    if(workers > 1 && durations)
     {
-      for(const auto & fileInFolder : files[fileListIdx])
-      {
-        const std::string subExt(bfs::extension(fileInFolder.second));
-
-        if((subExt == ".png") || (subExt == ".jpg") || (subExt == ".PNG") || (subExt == ".JPG"))
-        {
-
-          std::cerr << "Processing image " << fileInFolder.second.string() << std::endl;
-
-          cv::Mat src;
-          src = cv::imread(fileInFolder.second.string());
-
-          cv::Mat imgGray;
-          cv::cvtColor(src, imgGray, CV_BGR2GRAY);
+      // the images are detected concurrently; a single worker takes them one at a time
+      std::cerr << "The timing report needs sequential detection, ignoring --timing with --workers " << workers << std::endl;
+      durations = nullptr;
+    }
 
-          // Call the CCTag detection
-          int pipeId = (fileInFolder.first & 1);
-          boost::ptr_list<CCTag> markers;
+    for(int pass = 0; pass < loops; ++pass)
+    {
 #ifdef PRINT_TO_CERR
-          detection(fileInFolder.first, pipeId, imgGray, params, bank, markers, std::cerr, fileInFolder.second.stem().string());
+      processDirectory(images, workers, params, bank, std::cerr);
 #else
-          detection(fileInFolder.first, pipeId, imgGray, params, bank, markers, outputFile, fileInFolder.second.stem().string());
+      processDirectory(images, workers, params, bank, outputFile);
 #endif
-          std::cerr << "Done processing image " << fileInFolder.second.string() << std::endl;
-        }
-      }
-    });
+    }
   }
   else
   {
     std::cerr << "The input file format is not supported" << std::endl;
     throw std::logic_error("Unrecognized input.");
   }
+
+  if(benchmark)
+  {
+    const auto endTime = std::chrono::steady_clock::now();
+    benchmark->print(std::cout, std::chrono::duration<double>(endTime - startTime).count());
+  }
+
+  if(results)
+  {
+    results->close();
+  }
+
   outputFile.close();
   return EXIT_SUCCESS;
 }
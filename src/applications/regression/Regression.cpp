@@ -6,6 +6,11 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <thread>
+#include "cctag/utils/AllocCounters.hpp"
 #include "Regression.h"
 
 static void RemoveAllFiles(const boost::filesystem::path& dirPath);
@@ -14,9 +19,15 @@ static bool SortTags(FrameLog& log);
 
 /////////////////////////////////////////////////////////////////////////////
 
-TestRunner::TestRunner(const std::string& inputDir, const std::string& outputDir, boost::optional<bool> useCuda) :
-  _inputDirPath(inputDir), _outputDirPath(outputDir), _useCuda(useCuda)
+TestRunner::TestRunner(const std::string& inputDir, const std::string& outputDir, boost::optional<bool> useCuda,
+  boost::optional<size_t> allocBudget, size_t jobs) :
+  _inputDirPath(inputDir), _outputDirPath(outputDir), _useCuda(useCuda), _allocBudget(allocBudget),
+  _jobs(std::max(jobs, size_t(1))), _warm(false), _failed(false)
 {
+  if (_allocBudget && _jobs > 1)
+    throw std::runtime_error("TestRunner: allocation budget can only be checked with a single job");
+  if (_allocBudget && !cctag::logtime::allocAccountingEnabled())
+    throw std::runtime_error("TestRunner: allocation budget requires a library built with CCTAG_ALLOC_ACCOUNTING");
   if (!exists(_inputDirPath) || !is_directory(_inputDirPath))
     throw std::runtime_error("TestRunner: inputDir is not a directory");
   if (!exists(_outputDirPath) || !is_directory(_outputDirPath))
@@ -31,41 +42,110 @@ void TestRunner::adjustParameters(cctag::Parameters& parameters)
     parameters._useCuda = *_useCuda;
 }
 
+// Runs process on every input file, with _jobs files being processed concurrently.
+// process receives the file and the worker index, to be used as the detection pipe id.
+// The first exception thrown by process stops the processing of new files and is
+// rethrown once all the workers are done.
+void TestRunner::forEachInputFile(const std::function<void(const boost::filesystem::path&, int)>& process)
+{
+  if (_jobs == 1) {
+    for (const auto& inputFilePath: _inputFilePaths)
+      process(inputFilePath, 0);
+    return;
+  }
+  
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  auto worker = [&](int workerId) {
+    for (size_t i = next++; i < _inputFilePaths.size(); i = next++) {
+      try {
+        process(_inputFilePaths[i], workerId);
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!error)
+          error = std::current_exception();
+        next = _inputFilePaths.size();
+      }
+    }
+  };
+  
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < _jobs; ++i)
+    workers.emplace_back(worker, int(i));
+  for (auto& w: workers)
+    w.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// Steady-state check: every frame detected after the first one must not allocate
+// more than the budget. The very first frame warms up the detector.
+void TestRunner::checkAllocations(const FileLog& fileLog)
+{
+  if (!_allocBudget)
+    return;
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (const auto& frameLog: fileLog.frameLogs) {
+    if (_warm && frameLog.allocations > *_allocBudget) {
+      std::clog << "  FAILED: " << frameLog.allocations << " allocations in frame " << frameLog.frame
+        << ", budget is " << *_allocBudget << std::endl;
+      _failed = true;
+    }
+    _warm = true;
+  }
+}
+
 // Input directory must contain images.
 // NB! parameters is by-val since we may need to adjust them.
-void TestRunner::generateReferenceResults(cctag::Parameters parameters)
+// Returns false if the allocation budget has been exceeded.
+bool TestRunner::generateReferenceResults(cctag::Parameters parameters)
 {
   adjustParameters(parameters);
   size_t i = 1, count = _inputFilePaths.size();
-  for (const auto& inputFilePath: _inputFilePaths) {
-    std::clog << "Processing file " << i++ << "/" << count << ": " << inputFilePath << std::endl;
-    FileLog fileLog = FileLog::detect(inputFilePath.native(), parameters);
-    auto outputPath = _outputDirPath / inputFilePath.filename().replace_extension(".xml");
+  forEachInputFile([&](const boost::filesystem::path& inputFilePath, int pipeId) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::clog << "Processing file " << i++ << "/" << count << ": " << inputFilePath << std::endl;
+    }
+    FileLog fileLog = FileLog::detect(inputFilePath.native(), parameters, pipeId);
+    checkAllocations(fileLog);
+    fileLog.jobs = _jobs;
+    auto outputPath = _outputDirPath / inputFilePath.filename().replace_extension(FileLog::BinaryExtension);
     fileLog.save(outputPath.native());
-  }
+  });
+  return !_failed;
 }
 
-// Input directory must contain XML files; parameters and input file will be read from those.
-void TestRunner::generateTestResults()
+// Input directory must contain log files (XML or binary); parameters and input file will be read from those.
+// Returns false if the allocation budget has been exceeded.
+bool TestRunner::generateTestResults()
 {
   size_t i = 1, count = _inputFilePaths.size();
-  for (const auto& inputFilePath: _inputFilePaths)
-  if (inputFilePath.extension() == ".xml") {
-    std::clog << "Processing file " << i++ << "/" << count << ": " << inputFilePath << std::endl;
+  forEachInputFile([&](const boost::filesystem::path& inputFilePath, int pipeId) {
+    if (!FileLog::isLogFile(inputFilePath.native()))
+      return;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::clog << "Processing file " << i++ << "/" << count << ": " << inputFilePath << std::endl;
+    }
     FileLog fileLog;
     fileLog.load(inputFilePath.native());
     adjustParameters(fileLog.parameters);
-    fileLog = FileLog::detect(fileLog.filename, fileLog.parameters);
+    fileLog = FileLog::detect(fileLog.filename, fileLog.parameters, pipeId);
+    checkAllocations(fileLog);
+    fileLog.jobs = _jobs;
     auto outputPath = _outputDirPath / inputFilePath.filename();
     fileLog.save(outputPath.native());
-  }
+  });
+  return !_failed;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 // TestChecker assumption: all IDs in the frame are different.
 
 TestChecker::TestChecker(const std::string& referenceDir, const std::string& testDir, float epsilon) :
-  _referenceDirPath(referenceDir), _testDirPath(testDir), _epsilon(epsilon), _failed(false)
+  _referenceDirPath(referenceDir), _testDirPath(testDir), _epsilon(epsilon), _jobsMismatch(false), _failed(false)
 {
   if (!exists(_referenceDirPath) || !is_directory(_referenceDirPath))
     throw std::runtime_error("TestChecker: referenceDir is not a directory");
@@ -121,6 +201,8 @@ void TestChecker::compare(FileLog& referenceLog, FileLog& testLog)
     throw check_error("mismatching parameters");
   if (referenceLog.frameLogs.size() != testLog.frameLogs.size())
     throw check_error("mismatching frame counts");
+  if (referenceLog.jobs != testLog.jobs)
+    _jobsMismatch = true;
   if (!std::is_sorted(referenceLog.frameLogs.begin(), referenceLog.frameLogs.end(), frameOrdCmp))
     throw check_error("reference log frames not monotonic");
   if (!std::is_sorted(testLog.frameLogs.begin(), testLog.frameLogs.end(), frameOrdCmp))
@@ -134,6 +216,9 @@ void TestChecker::compare(FileLog& referenceLog, FileLog& testLog)
 
 void TestChecker::compare(FrameLog& referenceLog, FrameLog& testLog, size_t frame)
 {
+  _referenceLatencies.push_back(referenceLog.elapsedTime);
+  _testLatencies.push_back(testLog.elapsedTime);
+
   if (referenceLog.tags.size() != testLog.tags.size())
     throw check_error(std::string("different # of tags in frame ") + std::to_string(frame));
   if (!SortTags(referenceLog))
@@ -169,6 +254,36 @@ void TestChecker::compare(const DetectedTag& referenceTag, const DetectedTag& te
   }
 }
 
+// Fails if the p50 or p99 of the test latencies exceed the reference ones by more than
+// threshold (relative, e.g. 0.1 for 10%). Latencies measured with different numbers
+// of concurrent jobs are not comparable, so the check fails if any file pair differs.
+bool TestChecker::checkLatency(float threshold) const
+{
+  if (_jobsMismatch) {
+    std::clog << "  FAILED: reference and test latencies measured with different --jobs" << std::endl;
+    return false;
+  }
+  bool ok = true;
+  for (float p: { 0.5f, 0.99f }) {
+    const float ref = referenceLatencyPercentile(p), test = testLatencyPercentile(p);
+    if (test > ref * (1 + threshold)) {
+      std::clog << "  FAILED: p" << int(p * 100) << " latency regressed from " << ref << "s to " << test << "s" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// Nearest-rank percentile; p in [0,1].
+float TestChecker::Percentile(std::vector<float> values, float p)
+{
+  if (values.empty())
+    return 0;
+  const size_t rank = std::min(values.size() - 1, size_t(std::ceil(p * values.size())) - (p > 0));
+  std::nth_element(values.begin(), values.begin() + rank, values.end());
+  return values[rank];
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
 static void RemoveAllFiles(const boost::filesystem::path& dirPath)
@@ -7,6 +7,8 @@
  */
 #pragma once
 
+#include <functional>
+#include <mutex>
 #include <stdexcept>
 #include <boost/optional.hpp>
 #include <boost/filesystem.hpp>
@@ -23,14 +25,22 @@ class TestRunner
   const boost::filesystem::path _inputDirPath;
   const boost::filesystem::path _outputDirPath;
   const boost::optional<bool> _useCuda;
+  const boost::optional<size_t> _allocBudget;
+  const size_t _jobs;
   std::vector<boost::filesystem::path> _inputFilePaths;
+  std::mutex _mutex; // protects the fields below and the log output
+  bool _warm;
+  bool _failed;
   
   void adjustParameters(cctag::Parameters& parameters);
+  void checkAllocations(const FileLog& fileLog);
+  void forEachInputFile(const std::function<void(const boost::filesystem::path&, int)>& process);
   
 public:
-  TestRunner(const std::string& inputDir, const std::string& outputDir, boost::optional<bool> useCuda);
-  void generateReferenceResults(cctag::Parameters parameters);
-  void generateTestResults();
+  TestRunner(const std::string& inputDir, const std::string& outputDir, boost::optional<bool> useCuda,
+    boost::optional<size_t> allocBudget = boost::none, size_t jobs = 1);
+  bool generateReferenceResults(cctag::Parameters parameters);
+  bool generateTestResults();
 };
 
 class TestChecker
@@ -55,6 +65,9 @@ class TestChecker
   bacc::accumulator_set<float,
     bacc::stats<bacc::tag::mean,
                 bacc::tag::variance>> _qualityDiffAcc;  // over all tags in the dataset
+  std::vector<float> _referenceLatencies;               // over all frames in the dataset
+  std::vector<float> _testLatencies;                    // ditto
+  bool _jobsMismatch;                                   // some file pair was run with different --jobs
   bool _failed;
   
   void check(const boost::filesystem::path& testFilePath);
@@ -70,4 +83,9 @@ public:
   float elapsedTimeDifferenceStdev() { return sqrt(bacc::variance(_elapsedDiffAcc)); }
   float qualityDifferenceMean() { return bacc::mean(_qualityDiffAcc); }
   float qualityDifferenceStdev() { return sqrt(bacc::variance(_qualityDiffAcc)); }
+  float referenceLatencyPercentile(float p) const { return Percentile(_referenceLatencies, p); }
+  float testLatencyPercentile(float p) const { return Percentile(_testLatencies, p); }
+  bool checkLatency(float threshold) const;
+  
+  static float Percentile(std::vector<float> values, float p);
 };
@@ -5,9 +5,16 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <chrono>
+#include <sstream>
 #include <stdexcept>
 #include <boost/algorithm/string.hpp>
 #include <boost/serialization/vector.hpp>
@@ -15,42 +22,273 @@
 #include <boost/archive/xml_iarchive.hpp>
 #include <opencv2/videoio.hpp>
 #include <opencv2/opencv.hpp>
+#include "cctag/utils/AllocCounters.hpp"
 #include "TestLog.h"
 
 using namespace cctag;
 
 FrameLog FrameLog::detect(size_t frame, const cv::Mat& src, const Parameters& parameters,
-  const cctag::CCTagMarkersBank& bank)
+  const cctag::CCTagMarkersBank& bank, int pipeId)
 {
   using namespace std::chrono;
   CCTag::List markers;
   
+  const auto a0 = logtime::allocSnapshot();
   const auto t0 = high_resolution_clock::now();
-  cctagDetection(markers, 0, frame, src, parameters, bank, true, nullptr);
+  cctagDetection(markers, pipeId, frame, src, parameters, bank, true, nullptr);
   const auto t1 = high_resolution_clock::now();
-  const auto td = duration_cast<milliseconds>(t1 - t0).count() / 1000.f;
+  const auto a1 = logtime::allocSnapshot();
+  const auto td = duration_cast<microseconds>(t1 - t0).count() / 1e6f;
   
-  return FrameLog(frame, td, markers);
+  FrameLog frameLog(frame, td, markers);
+  frameLog.allocations = a1._count - a0._count;
+  return frameLog;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 
 static const char* TOPLEVEL_XML_ELEMENT("FileLog");
+static const char* PARAMETERS_XML_ELEMENT("CCTagsParams");
+
+// Binary log layout, in native byte order; every section is padded to 8 bytes:
+// BinaryLogHeader, filename, parameters as XML archive, frameCount BinaryLogFrame,
+// tagCount BinaryLogTag. The tags of a frame follow those of the previous frame.
+namespace {
+
+// Version 2 adds jobs; version 1 logs have a 40 byte header and were produced by a single job.
+const uint32_t BINARY_LOG_VERSION = 2;
+const size_t BINARY_LOG_V1_HEADER_SIZE = 40;
+
+struct BinaryLogHeader
+{
+  char magic[8];          // "CCTAGLOG"
+  uint32_t version;
+  uint32_t filenameSize;
+  uint64_t parametersSize;
+  uint64_t frameCount;
+  uint64_t tagCount;
+  uint64_t jobs;
+};
+
+struct BinaryLogFrame
+{
+  uint64_t frame;
+  float elapsedTime;
+  uint32_t tagCount;
+};
+
+struct BinaryLogTag
+{
+  int32_t id, status;
+  float x, y, quality;
+};
+
+static_assert(sizeof(BinaryLogHeader) == 48, "BinaryLogHeader not packed");
+static_assert(sizeof(BinaryLogFrame) == 16, "BinaryLogFrame not packed");
+static_assert(sizeof(BinaryLogTag) == 20, "BinaryLogTag not packed");
+
+size_t Padded(size_t size)
+{
+  return (size + 7) & ~size_t(7);
+}
+
+void WritePadded(std::ofstream& ofs, const void* data, size_t size)
+{
+  static const char zeros[8] = { 0 };
+  ofs.write(static_cast<const char*>(data), size);
+  ofs.write(zeros, Padded(size) - size);
+}
+
+// Read-only mapping of a whole file.
+class MappedFile
+{
+  const char* _data;
+  size_t _size;
+  
+public:
+  MappedFile(const std::string& filename) : _data(nullptr), _size(0)
+  {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error(std::string("FileLog: unable to open ") + filename);
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        _data = static_cast<const char*>(data);
+        _size = st.st_size;
+      }
+    }
+    ::close(fd);
+  }
+  
+  ~MappedFile()
+  {
+    if (_data)
+      ::munmap(const_cast<char*>(_data), _size);
+  }
+  
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  
+  const char* data() const { return _data; }
+  size_t size() const { return _size; }
+};
+
+} // namespace
+
+const char* const FileLog::BinaryExtension = ".cctaglog";
 
 void FileLog::save(const std::string& filename)
+{
+  using namespace boost::algorithm;
+  if (iends_with(filename, ".xml"))
+    saveXml(filename);
+  else
+    saveBinary(filename);
+}
+
+void FileLog::load(const std::string& filename)
+{
+  if (!loadBinary(filename))
+    loadXml(filename);
+}
+
+bool FileLog::isLogFile(const std::string& filename)
+{
+  using namespace boost::algorithm;
+  return iends_with(filename, ".xml") || iends_with(filename, BinaryExtension);
+}
+
+void FileLog::saveXml(const std::string& filename)
 {
   std::ofstream ofs(filename);
   boost::archive::xml_oarchive oa(ofs);
   oa << boost::serialization::make_nvp(TOPLEVEL_XML_ELEMENT, *this);
 }
 
-void FileLog::load(const std::string& filename)
+void FileLog::loadXml(const std::string& filename)
 {
   std::ifstream ifs(filename);
   boost::archive::xml_iarchive ia(ifs);
   ia >> boost::serialization::make_nvp(TOPLEVEL_XML_ELEMENT, *this);
 }
 
+void FileLog::saveBinary(const std::string& filename)
+{
+  std::string parametersXml;
+  {
+    std::ostringstream oss;
+    {
+      boost::archive::xml_oarchive oa(oss);
+      oa << boost::serialization::make_nvp(PARAMETERS_XML_ELEMENT, parameters);
+    }
+    parametersXml = oss.str();
+  }
+  
+  BinaryLogHeader header;
+  std::memcpy(header.magic, "CCTAGLOG", 8);
+  header.version = BINARY_LOG_VERSION;
+  header.filenameSize = this->filename.size();
+  header.parametersSize = parametersXml.size();
+  header.frameCount = frameLogs.size();
+  header.tagCount = 0;
+  header.jobs = jobs;
+  for (const auto& frameLog: frameLogs)
+    header.tagCount += frameLog.tags.size();
+  
+  std::vector<BinaryLogFrame> frames;
+  std::vector<BinaryLogTag> tags;
+  frames.reserve(header.frameCount);
+  tags.reserve(header.tagCount);
+  for (const auto& frameLog: frameLogs) {
+    frames.push_back({ frameLog.frame, frameLog.elapsedTime, uint32_t(frameLog.tags.size()) });
+    for (const auto& tag: frameLog.tags)
+      tags.push_back({ tag.id, tag.status, tag.x, tag.y, tag.quality });
+  }
+  
+  std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+  if (!ofs)
+    throw std::runtime_error(std::string("FileLog: unable to create ") + filename);
+  WritePadded(ofs, &header, sizeof(header));
+  WritePadded(ofs, this->filename.data(), this->filename.size());
+  WritePadded(ofs, parametersXml.data(), parametersXml.size());
+  WritePadded(ofs, frames.data(), frames.size() * sizeof(BinaryLogFrame));
+  WritePadded(ofs, tags.data(), tags.size() * sizeof(BinaryLogTag));
+  if (!ofs)
+    throw std::runtime_error(std::string("FileLog: unable to write ") + filename);
+}
+
+// Returns false if the file is not a binary log.
+bool FileLog::loadBinary(const std::string& filename)
+{
+  MappedFile file(filename);
+  if (file.size() < BINARY_LOG_V1_HEADER_SIZE || std::memcmp(file.data(), "CCTAGLOG", 8) != 0)
+    return false;
+  
+  BinaryLogHeader header;
+  std::memcpy(&header, file.data(), BINARY_LOG_V1_HEADER_SIZE);
+  size_t headerSize = BINARY_LOG_V1_HEADER_SIZE;
+  header.jobs = 1;
+  if (header.version == BINARY_LOG_VERSION) {
+    if (file.size() < sizeof(header))
+      throw std::runtime_error(std::string("FileLog: truncated binary log ") + filename);
+    std::memcpy(&header, file.data(), sizeof(header));
+    headerSize = sizeof(header);
+  }
+  else if (header.version != 1)
+    throw std::runtime_error(std::string("FileLog: unsupported binary log version in ") + filename);
+  
+  // The sizes come from the file: each section is checked against the bytes left
+  // before its offset is computed, without any product or sum that could overflow.
+  size_t offset = Padded(headerSize);
+  auto section = [&](uint64_t count, size_t elementSize) {
+    const size_t remaining = file.size() - offset;
+    if (count > remaining / elementSize)
+      throw std::runtime_error(std::string("FileLog: truncated binary log ") + filename);
+    const size_t sectionOffset = offset;
+    offset += std::min(Padded(size_t(count) * elementSize), remaining);
+    return sectionOffset;
+  };
+  const size_t filenameOffset = section(header.filenameSize, 1);
+  const size_t parametersOffset = section(header.parametersSize, 1);
+  const size_t framesOffset = section(header.frameCount, sizeof(BinaryLogFrame));
+  const size_t tagsOffset = section(header.tagCount, sizeof(BinaryLogTag));
+  
+  this->filename.assign(file.data() + filenameOffset, header.filenameSize);
+  jobs = header.jobs;
+  {
+    std::istringstream iss(std::string(file.data() + parametersOffset, header.parametersSize));
+    boost::archive::xml_iarchive ia(iss);
+    ia >> boost::serialization::make_nvp(PARAMETERS_XML_ELEMENT, parameters);
+  }
+  
+  const BinaryLogFrame* frames = reinterpret_cast<const BinaryLogFrame*>(file.data() + framesOffset);
+  const BinaryLogTag* tags = reinterpret_cast<const BinaryLogTag*>(file.data() + tagsOffset);
+  const BinaryLogTag* const tagsEnd = tags + header.tagCount;
+  
+  frameLogs.clear();
+  frameLogs.reserve(header.frameCount);
+  for (size_t i = 0; i < header.frameCount; ++i) {
+    FrameLog frameLog;
+    frameLog.frame = frames[i].frame;
+    frameLog.elapsedTime = frames[i].elapsedTime;
+    if (size_t(tagsEnd - tags) < frames[i].tagCount)
+      throw std::runtime_error(std::string("FileLog: inconsistent binary log ") + filename);
+    frameLog.tags.resize(frames[i].tagCount);
+    for (auto& tag: frameLog.tags) {
+      tag.id = tags->id;
+      tag.status = tags->status;
+      tag.x = tags->x;
+      tag.y = tags->y;
+      tag.quality = tags->quality;
+      ++tags;
+    }
+    frameLogs.push_back(std::move(frameLog));
+  }
+  return true;
+}
+
 bool FileLog::isSupportedImage(const std::string& filename)
 {
   using namespace boost::algorithm;
@@ -68,18 +306,18 @@ bool FileLog::isSupportedFormat(const std::string& filename)
   return isSupportedImage(filename) || isSupportedVideo(filename);
 }
 
-FileLog FileLog::detect(const std::string& filename, const Parameters& parameters)
+FileLog FileLog::detect(const std::string& filename, const Parameters& parameters, int pipeId)
 {
   if (parameters._nCrowns != 3 && parameters._nCrowns != 4)
     throw std::runtime_error("FileLog: unsupported number of crowns; can only be 3 or 4");
   if (isSupportedImage(filename))
-    return detectImage(filename, parameters);
+    return detectImage(filename, parameters, pipeId);
   if(isSupportedVideo(filename))
-    return detectVideo(filename, parameters);
+    return detectVideo(filename, parameters, pipeId);
   throw std::runtime_error(std::string("FileLog: unsupported format for file ") + filename);
 }
 
-FileLog FileLog::detectImage(const std::string& filename, const cctag::Parameters& parameters)
+FileLog FileLog::detectImage(const std::string& filename, const cctag::Parameters& parameters, int pipeId)
 {
   FileLog fileLog(filename, parameters);
   CCTagMarkersBank bank(parameters._nCrowns);
@@ -90,12 +328,12 @@ FileLog FileLog::detectImage(const std::string& filename, const cctag::Parameter
     throw std::runtime_error(std::string("FileLog: unable to read image file: ") + filename);
   cv::cvtColor(src, gray, CV_BGR2GRAY);
   
-  auto frameLog = FrameLog::detect(0, gray, parameters, bank);
+  auto frameLog = FrameLog::detect(0, gray, parameters, bank, pipeId);
   fileLog.frameLogs.push_back(frameLog);
   return fileLog;
 }
 
-FileLog FileLog::detectVideo(const std::string& filename, const cctag::Parameters& parameters)
+FileLog FileLog::detectVideo(const std::string& filename, const cctag::Parameters& parameters, int pipeId)
 {
   FileLog fileLog(filename, parameters);
   CCTagMarkersBank bank(parameters._nCrowns);
@@ -110,7 +348,7 @@ FileLog FileLog::detectVideo(const std::string& filename, const cctag::Parameter
   for (size_t i = 0; i < lastFrame; ++i) {
     video >> src;
     cv::cvtColor(src, gray, CV_BGR2GRAY);
-    auto frameLog = FrameLog::detect(i, gray, parameters, bank);
+    auto frameLog = FrameLog::detect(i, gray, parameters, bank, pipeId);
     fileLog.frameLogs.push_back(frameLog);
   }
   
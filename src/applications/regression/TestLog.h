@@ -10,6 +10,7 @@
 #include <vector>
 #include <opencv/cv.h>
 #include <boost/serialization/nvp.hpp>
+#include <boost/serialization/version.hpp>
 #include "cctag/Detection.hpp"
 #include "cctag/Params.hpp"
 
@@ -43,6 +44,7 @@ struct FrameLog
   size_t frame;
   float elapsedTime;
   std::vector<DetectedTag> tags;
+  size_t allocations = 0; // heap allocations made by the detection; not serialized
   
   template<typename Archive>
   void serialize(Archive& ar, const unsigned)
@@ -59,7 +61,7 @@ struct FrameLog
   { }
 
   static FrameLog detect(size_t frame, const cv::Mat& src, const cctag::Parameters& parameters,
-    const cctag::CCTagMarkersBank& bank);
+    const cctag::CCTagMarkersBank& bank, int pipeId = 0);
 };
 
 struct FileLog
@@ -67,13 +69,16 @@ struct FileLog
   std::string filename;
   cctag::Parameters parameters;
   std::vector<FrameLog> frameLogs;
+  size_t jobs = 1;  // files processed concurrently while the latencies were measured
   
   template<typename Archive>
-  void serialize(Archive& ar, const unsigned)
+  void serialize(Archive& ar, const unsigned version)
   {
     ar & BOOST_SERIALIZATION_NVP(filename);
     ar & BOOST_SERIALIZATION_NVP(parameters);
     ar & BOOST_SERIALIZATION_NVP(frameLogs);
+    if (version >= 1)
+      ar & BOOST_SERIALIZATION_NVP(jobs);
   }
   
   FileLog() = default;
@@ -82,15 +87,27 @@ struct FileLog
     filename(filename), parameters(parameters)
   { }
   
+  // Logs with the .xml extension are boost XML archives, all others are binary logs.
+  // load() recognizes binary logs by their signature, whatever their extension.
   void save(const std::string& filename);
   void load(const std::string& filename);
   
+  static const char* const BinaryExtension;
+  static bool isLogFile(const std::string& filename);
   static bool isSupportedFormat(const std::string& filename);
-  static FileLog detect(const std::string& filename, const cctag::Parameters& parameters);
+  static FileLog detect(const std::string& filename, const cctag::Parameters& parameters, int pipeId = 0);
   
 private:
+  void saveXml(const std::string& filename);
+  void loadXml(const std::string& filename);
+  void saveBinary(const std::string& filename);
+  bool loadBinary(const std::string& filename);
+  
   static bool isSupportedImage(const std::string& filename);
   static bool isSupportedVideo(const std::string& filename);
-  static FileLog detectImage(const std::string& filename, const cctag::Parameters& parameters);
-  static FileLog detectVideo(const std::string& filename, const cctag::Parameters& parameters);
+  static FileLog detectImage(const std::string& filename, const cctag::Parameters& parameters, int pipeId);
+  static FileLog detectVideo(const std::string& filename, const cctag::Parameters& parameters, int pipeId);
 };
+
+// Version 1 adds jobs.
+BOOST_CLASS_VERSION(FileLog, 1)
@@ -9,6 +9,8 @@
 #include <fstream>
 #include <string>
 #include <boost/archive/xml_iarchive.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include "Regression.h"
 
@@ -17,6 +19,9 @@ static std::string DestinationDir;
 static std::string ParametersFile;
 static float Epsilon;
 static boost::optional<bool> UseCuda;
+static boost::optional<size_t> AllocBudget;
+static size_t Jobs;
+static boost::optional<float> LatencyThreshold;
 
 static std::string ParseOptions(int argc, char **argv)
 {
@@ -28,8 +33,11 @@ static std::string ParseOptions(int argc, char **argv)
     ("gen-ref", "Generate reference results from images in the source directory")
     ("gen-test", "Generate test results based on settings from reference results in the source directory")
     ("compare", "Compare reference results in the source directory with results in the destination directory")
+    ("convert", "Convert the logs in the source directory to the destination directory, XML to binary and binary to XML")
     ("use-cuda", value<bool>()->notifier([](bool v) { UseCuda = v; }),
       "Overrides implementation specified by parameters")
+    ("alloc-budget", value<size_t>()->notifier([](size_t v) { AllocBudget = v; }),
+      "Fail generation if a frame after the first one makes more operator new allocations (requires CCTAG_ALLOC_ACCOUNTING; cv::Mat buffers are not counted)")
     ("help", "Print help");
   
   options_description data_desc("Data specification options");
@@ -37,7 +45,10 @@ static std::string ParseOptions(int argc, char **argv)
     ("src-dir", value<std::string>(&SourceDir), "Source directory")
     ("dst-dir", value<std::string>(&DestinationDir), "Destination directory [WARNING: current contents will be lost]")
     ("parameters", value<std::string>(&ParametersFile), "Detection parameters file")
-    ("epsilon", value<float>(&Epsilon)->default_value(0.5f), "Position tolerance for x/y coordinates");
+    ("epsilon", value<float>(&Epsilon)->default_value(0.5f), "Position tolerance for x/y coordinates")
+    ("jobs", value<size_t>(&Jobs)->default_value(1), "Number of files processed concurrently in generate modes; recorded in the logs")
+    ("latency-threshold", value<float>()->notifier([](float v) { LatencyThreshold = v; }),
+      "Fail compare if p50 or p99 frame latency regresses by more than this fraction, e.g. 0.1; the logs must have been generated with the same --jobs");
   
   all_desc.add(data_desc);
   
@@ -77,6 +88,14 @@ static std::string ParseOptions(int argc, char **argv)
     mode = "compare";
   }
   
+  if (vm.count("convert")) {
+    if (!mode.empty())
+      throw error("only one mode option can be specified");
+    if (!vm.count("src-dir") || !vm.count("dst-dir"))
+      throw error("convert: src-dir and dst-dir are mandatory");
+    mode = "convert";
+  }
+  
   if (mode.empty())
     throw error("exactly one mode option must be specified");
   
@@ -84,9 +103,9 @@ static std::string ParseOptions(int argc, char **argv)
   return mode;
 }
 
-static void GenerateReference()
+static bool GenerateReference()
 {
-  TestRunner testRunner(SourceDir, DestinationDir, UseCuda);
+  TestRunner testRunner(SourceDir, DestinationDir, UseCuda, AllocBudget, Jobs);
   cctag::Parameters parameters;
   
   {
@@ -95,7 +114,30 @@ static void GenerateReference()
     ia >> boost::serialization::make_nvp("CCTagsParams", parameters);
   }
 
-  testRunner.generateReferenceResults(parameters);
+  return testRunner.generateReferenceResults(parameters);
+}
+
+static bool ConvertLogs()
+{
+  using namespace boost::filesystem;
+  create_directories(DestinationDir);
+  
+  directory_iterator it(SourceDir), end;
+  for (; it != end; ++it) {
+    const path& inputPath = it->path();
+    if (!is_regular_file(inputPath) || !FileLog::isLogFile(inputPath.native()))
+      continue;
+    
+    const bool toXml = !boost::algorithm::iends_with(inputPath.native(), ".xml");
+    const path outputPath = path(DestinationDir) / inputPath.filename().replace_extension(
+      toXml ? ".xml" : FileLog::BinaryExtension);
+    std::clog << "Converting " << inputPath << " to " << outputPath << std::endl;
+    
+    FileLog fileLog;
+    fileLog.load(inputPath.native());
+    fileLog.save(outputPath.native());
+  }
+  return true;
 }
 
 static bool ReportChecks()
@@ -109,6 +151,15 @@ static bool ReportChecks()
   std::clog << "Performance difference report:\n";
   std::clog << "  time,    mean=" << testChecker.elapsedTimeDifferenceMean() << ",stdev=" << testChecker.elapsedTimeDifferenceStdev() << std::endl;
   std::clog << "  quality, mean=" << testChecker.qualityDifferenceMean() << ",stdev=" << testChecker.qualityDifferenceStdev() << std::endl;
+  std::clog << "  latency, reference p50=" << testChecker.referenceLatencyPercentile(0.5f)
+            << ",p99=" << testChecker.referenceLatencyPercentile(0.99f)
+            << "; test p50=" << testChecker.testLatencyPercentile(0.5f)
+            << ",p99=" << testChecker.testLatencyPercentile(0.99f) << std::endl;
+  
+  if (LatencyThreshold && !testChecker.checkLatency(*LatencyThreshold)) {
+    std::clog << "Latency check FAILED" << std::endl;
+    ok = false;
+  }
   
   return ok;
 }
@@ -122,14 +173,14 @@ int main(int argc, char **argv)
     else std::clog << "CUDA override NOT SET; will use parameters" << std::endl;
     
     if (mode == "gen-ref") {
-      GenerateReference();
-      return EXIT_SUCCESS;
+      bool ok = GenerateReference();
+      return ok ? EXIT_SUCCESS : EXIT_FAILURE;
     }
     
     if (mode == "gen-test") {
-      TestRunner testRunner(SourceDir, DestinationDir, UseCuda);
-      testRunner.generateTestResults();
-      return EXIT_SUCCESS;
+      TestRunner testRunner(SourceDir, DestinationDir, UseCuda, AllocBudget, Jobs);
+      bool ok = testRunner.generateTestResults();
+      return ok ? EXIT_SUCCESS : EXIT_FAILURE;
     }
     
     if (mode == "compare") {
@@ -137,6 +188,11 @@ int main(int argc, char **argv)
       return ok ? EXIT_SUCCESS : EXIT_FAILURE;
     }
     
+    if (mode == "convert") {
+      bool ok = ConvertLogs();
+      return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
     throw std::logic_error("internal error: invalid mode");
   }
   catch (boost::program_options::error& e) {
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <cctag/AsyncDetection.hpp>
+#include <cctag/Detection.hpp>
+#include <cctag/ImagePyramid.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace cctag {
+
+namespace {
+
+struct Job
+{
+  std::size_t _frame;
+  cv::Mat _image;
+  std::unique_ptr<ImagePyramid> _imagePyramid;
+  CCTag::List _markers;
+  std::promise<CCTag::List> _result;
+  bool _failed = false;
+};
+
+} // anonymous namespace
+
+// Each stage runs on its own thread, so progress never depends on the TBB
+// pool having idle workers; the parallel loops inside the stages still use it.
+struct AsyncDetector::Impl
+{
+  const Parameters _params;
+  const CCTagMarkersBank& _bank;
+  const std::size_t _depth;
+  DetectionObserver* const _observer;
+
+  std::mutex _mutex;
+  std::condition_variable _changed;
+  std::deque<Job*> _toLocalize;
+  std::deque<Job*> _toIdentify;
+  std::size_t _inFlight = 0;
+  bool _stopping = false;
+
+  std::thread _localizer;
+  std::thread _identifier;
+
+  Impl(const Parameters & params, const CCTagMarkersBank & bank, std::size_t depth,
+       DetectionObserver* observer);
+  ~Impl();
+  // Returns null when stopping.
+  Job* pop(std::deque<Job*>& queue);
+  void localize();
+  void identify();
+};
+
+AsyncDetector::Impl::Impl(const Parameters & params, const CCTagMarkersBank & bank, std::size_t depth,
+                          DetectionObserver* observer)
+  : _params(Parameters::OverrideLoaded ? Parameters::Override : params)
+  , _bank(bank)
+  , _depth(std::max(depth, std::size_t(2)))
+  , _observer(observer)
+{
+  _localizer = std::thread(&Impl::localize, this);
+  _identifier = std::thread(&Impl::identify, this);
+}
+
+AsyncDetector::Impl::~Impl()
+{
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _changed.notify_all();
+  _localizer.join();
+  _identifier.join();
+}
+
+Job* AsyncDetector::Impl::pop(std::deque<Job*>& queue)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _changed.wait(lock, [&]() { return _stopping || !queue.empty(); });
+  if(queue.empty())
+    return nullptr;
+  Job* job = queue.front();
+  queue.pop_front();
+  return job;
+}
+
+void AsyncDetector::Impl::localize()
+{
+  while(Job* job = pop(_toLocalize))
+  {
+    try
+    {
+      job->_imagePyramid.reset(new ImagePyramid(job->_image.cols, job->_image.rows,
+                                                _params._numberOfProcessedMultiresLayers, false));
+      cctagLocalization(job->_markers, job->_frame, job->_image, *job->_imagePyramid, _params,
+                        nullptr, _observer);
+    }
+    catch(...)
+    {
+      job->_result.set_exception(std::current_exception());
+      job->_failed = true;
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _toIdentify.push_back(job);
+    }
+    _changed.notify_all();
+  }
+}
+
+void AsyncDetector::Impl::identify()
+{
+  while(Job* job = pop(_toIdentify))
+  {
+    std::unique_ptr<Job> owner(job);
+    if(!job->_failed)
+    {
+      try
+      {
+        cctagIdentification(job->_markers, job->_frame, *job->_imagePyramid, nullptr, _params, _bank,
+                            nullptr, _observer);
+        job->_result.set_value(job->_markers);
+      }
+      catch(...)
+      {
+        job->_result.set_exception(std::current_exception());
+      }
+    }
+    owner.reset();
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      --_inFlight;
+    }
+    _changed.notify_all();
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+AsyncDetector::AsyncDetector(const Parameters & params, const CCTagMarkersBank & bank, std::size_t depth,
+                             DetectionObserver* observer)
+{
+  if(params._useCuda)
+    throw std::invalid_argument("AsyncDetector: CPU only, use the CUDA pipes for GPU detection");
+  _impl.reset(new Impl(params, bank, depth, observer));
+}
+
+AsyncDetector::~AsyncDetector()
+{
+  wait();
+}
+
+std::future<CCTag::List> AsyncDetector::submit(std::size_t frame, const cv::Mat & imgGraySrc)
+{
+  std::unique_ptr<Job> job(new Job);
+  job->_frame = frame;
+  job->_image = imgGraySrc.clone();
+  std::future<CCTag::List> result = job->_result.get_future();
+
+  {
+    std::unique_lock<std::mutex> lock(_impl->_mutex);
+    _impl->_changed.wait(lock, [this]() { return _impl->_inFlight < _impl->_depth; });
+    ++_impl->_inFlight;
+    _impl->_toLocalize.push_back(job.release());
+  }
+  _impl->_changed.notify_all();
+  return result;
+}
+
+void AsyncDetector::wait()
+{
+  std::unique_lock<std::mutex> lock(_impl->_mutex);
+  _impl->_changed.wait(lock, [this]() { return _impl->_inFlight == 0; });
+}
+
+} // namespace cctag
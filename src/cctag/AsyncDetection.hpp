@@ -0,0 +1,82 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _CCTAG_ASYNCDETECTION_HPP
+#define _CCTAG_ASYNCDETECTION_HPP
+
+#include <cctag/CCTag.hpp>
+#include <cctag/CCTagMarkersBank.hpp>
+#include <cctag/Params.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include <future>
+#include <memory>
+
+namespace cctag {
+
+class DetectionObserver;
+
+/**
+ * @brief Asynchronous CPU detection of a single stream of frames.
+ *
+ * The detection of a frame is split in two stages, localization (pyramid,
+ * Canny, voting, ellipse fitting) and identification, each running on its own
+ * thread and frame at a time: the localization of frame N+1 overlaps the
+ * identification of frame N, and both spread their loops on the shared TBB
+ * pool. Results are delivered in submission order and are the same as those
+ * of cctagDetection.
+ *
+ * This is the CPU counterpart of the load()/tagframe() split of the CUDA
+ * TagPipe; CUDA parameters are rejected.
+ */
+class AsyncDetector
+{
+public:
+  /**
+   * @param[in] params The detection parameters, copied.
+   * @param[in] bank The marker bank; must outlive the detector.
+   * @param[in] depth Maximum number of frames in flight, at least 2 (double
+   * buffering); submit() blocks when it is reached.
+   * @param[in] observer Optional, see cctagDetection. localized() and
+   * identified() are called from the two stage threads, so they may run
+   * concurrently for different frames.
+   */
+  AsyncDetector(const Parameters & params, const CCTagMarkersBank & bank, std::size_t depth = 2,
+                DetectionObserver* observer = nullptr);
+
+  /**
+   * @brief Waits for all submitted frames.
+   */
+  ~AsyncDetector();
+
+  AsyncDetector(const AsyncDetector&) = delete;
+  AsyncDetector& operator=(const AsyncDetector&) = delete;
+
+  /**
+   * @brief Queue a frame for detection. The image is copied, so the caller
+   * may reuse it as soon as this returns.
+   *
+   * @param[in] frame A frame number.
+   * @param[in] imgGraySrc Gray scale or YUYV image, as for cctagDetection.
+   * @return The markers of the frame, as returned by cctagDetection.
+   */
+  std::future<CCTag::List> submit(std::size_t frame, const cv::Mat & imgGraySrc);
+
+  /**
+   * @brief Wait until all submitted frames have been processed.
+   */
+  void wait();
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> _impl;
+};
+
+} // namespace cctag
+
+#endif
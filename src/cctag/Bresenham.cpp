@@ -62,13 +62,13 @@ EdgePoint* gradientDirectionDescent(
     int x = p.x();
     int y = p.y();
     
-    CCTagFileDebug::instance().newVote(x,y,dx,dy);
+    CCTAG_VOTE_DEBUG_HOOK(newVote(x,y,dx,dy));
 
     if( ady > adx )
     {
 
         updateXY(dy,dx,y,x,e,stpY,stpX);
-        CCTagFileDebug::instance().addFieldLinePoint(x, y);
+        CCTAG_VOTE_DEBUG_HOOK(addFieldLinePoint(x, y));
         
         n = n+1;
 
@@ -82,7 +82,7 @@ EdgePoint* gradientDirectionDescent(
         }
 
         updateXY(dy,dx,y,x,e,stpY,stpX);
-        CCTagFileDebug::instance().addFieldLinePoint(x, y);
+        CCTAG_VOTE_DEBUG_HOOK(addFieldLinePoint(x, y));
         n = n+1;
 
         if( x >= 0 && x < canny.shape()[0] &&
@@ -102,7 +102,7 @@ EdgePoint* gradientDirectionDescent(
         while( n <= nmax)
         {
             updateXY(dy,dx,y,x,e, stpY,stpX);
-            CCTagFileDebug::instance().addFieldLinePoint(x, y);
+            CCTAG_VOTE_DEBUG_HOOK(addFieldLinePoint(x, y));
             n = n+1;
 
             if( x >= 0 && x < canny.shape()[0] &&
@@ -139,7 +139,7 @@ EdgePoint* gradientDirectionDescent(
     else
     {
         updateXY(dx,dy,x,y,e,stpX,stpY);
-        CCTagFileDebug::instance().addFieldLinePoint(x, y);
+        CCTAG_VOTE_DEBUG_HOOK(addFieldLinePoint(x, y));
         n = n+1;
 
         if ( dx*dx+dy*dy > thrGradient )
@@ -152,7 +152,7 @@ EdgePoint* gradientDirectionDescent(
         }
 
         updateXY(dx,dy,x,y,e,stpX,stpY);
-        CCTagFileDebug::instance().addFieldLinePoint(x, y);
+        CCTAG_VOTE_DEBUG_HOOK(addFieldLinePoint(x, y));
         n = n+1;
 
         if( x >= 0 && x < canny.shape()[0] &&
@@ -172,7 +172,7 @@ EdgePoint* gradientDirectionDescent(
         while( n <= nmax)
         {
             updateXY(dx,dy,x,y,e,stpX,stpY);
-            CCTagFileDebug::instance().addFieldLinePoint(x, y);
+            CCTAG_VOTE_DEBUG_HOOK(addFieldLinePoint(x, y));
             n = n+1;
 
             if( x >= 0 && x < canny.shape()[0] &&
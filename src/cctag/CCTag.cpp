@@ -109,6 +109,49 @@ void CCTag::scale(float s)
   _outerEllipse.setB(_outerEllipse.b() * s);
 }
 
+void CCTag::translate(float dx, float dy)
+{
+  // _outerEllipse and _points are expressed in their pyramid level.
+  const float ldx = dx / _scale;
+  const float ldy = dy / _scale;
+
+  for(std::vector< DirectedPoint2d<Eigen::Vector3f> > &vp : _points)
+  {
+    for(DirectedPoint2d<Eigen::Vector3f> & p : vp)
+    {
+      p.x() += ldx;
+      p.y() += ldy;
+    }
+  }
+
+  _outerEllipse.setCenter(Point2d<Eigen::Vector3f>(_outerEllipse.center().x() + ldx,
+                          _outerEllipse.center().y() + ldy));
+
+  for(DirectedPoint2d<Eigen::Vector3f> & p : _rescaledOuterEllipsePoints)
+  {
+    p.x() += dx;
+    p.y() += dy;
+  }
+
+  _rescaledOuterEllipse.setCenter(Point2d<Eigen::Vector3f>(_rescaledOuterEllipse.center().x() + dx,
+                                  _rescaledOuterEllipse.center().y() + dy));
+
+  for(cctag::numerical::geometry::Ellipse & ellipse : _ellipses)
+  {
+    ellipse.setCenter(Point2d<Eigen::Vector3f>(ellipse.center().x() + dx,
+                      ellipse.center().y() + dy));
+  }
+
+  _centerImg.x() += dx;
+  _centerImg.y() += dy;
+
+  Eigen::Matrix3f mT;
+  mT << 1.f, 0.f, dx,
+        0.f, 1.f, dy,
+        0.f, 0.f, 1.f;
+  _mHomography = mT * _mHomography;
+}
+
 #ifdef CCTAG_WITH_CUDA
 void CCTag::acquireNearbyPointMemory( int tagId )
 {
@@ -55,6 +55,7 @@ public:
     : _id(0)
     , _quality(0)
     , _status(0)
+    , _centerSearchSize(0.f)
 #ifdef CCTAG_WITH_CUDA
     , _cuda_result( nullptr )
 #endif
@@ -78,6 +79,7 @@ public:
     , _quality(quality)
     , _pyramidLevel(pyramidLevel)
     , _scale(scale)
+    , _centerSearchSize(0.f)
 #ifdef CCTAG_WITH_CUDA
     , _cuda_result( nullptr )
 #endif
@@ -103,6 +105,7 @@ public:
     , _scale(cctag._scale)
     , _rescaledOuterEllipse(cctag._rescaledOuterEllipse)
     , _status(cctag._status)
+    , _centerSearchSize(cctag._centerSearchSize)
 #ifdef CCTAG_WITH_CUDA
     , _cuda_result( nullptr )
 #endif
@@ -120,6 +123,12 @@ public:
 
   void scale(float s);
 
+  /**
+   * @brief Move the marker by (dx, dy) full resolution pixels, e.g. from the
+   * coordinates of a region of interest to those of the whole image.
+   */
+  void translate(float dx, float dy);
+
   float x() const override {
     return _centerImg.x();
   }
@@ -289,6 +298,23 @@ public:
     _status = status;
   }
 
+  /**
+   * @brief Size of the neighbourhood of centerImg() in which the identification
+   * starts the search of the imaged center, relatively to the longest semi-axis of
+   * the outer ellipse. 0, the default, stands for Parameters::_imagedCenterNeighbourSize;
+   * a smaller value skips iterations when centerImg() is already close, e.g.
+   * predicted from a previous frame. Not used by the CUDA identification.
+   */
+  float centerSearchSize() const
+  {
+    return _centerSearchSize;
+  }
+
+  void setCenterSearchSize(float centerSearchSize)
+  {
+    _centerSearchSize = centerSearchSize;
+  }
+
   bool operator<(const CCTag & tag2) const
   {
     return _id < tag2.id();
@@ -392,6 +418,7 @@ protected:
   int    _pyramidLevel;
   float _scale;
   int    _status;
+  float _centerSearchSize;
 #ifdef CCTAG_WITH_CUDA
   /** Pointer into pinned memory page.
    *  Valid from the construction of the CCTag until identify()
@@ -420,6 +447,7 @@ static const int no_selected_cuts = -2;
 static const int opti_has_diverged = -3;
 static const int id_not_reliable = -4;
 static const int degenerate = -5;
+static const int implausible_signal = -6;
 }
 
 } // namespace cctag
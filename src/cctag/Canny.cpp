@@ -18,12 +18,19 @@ void edgesPointsFromCanny(
         const cv::Mat & dx,
         const cv::Mat & dy )
 {
-  std::size_t width = edges.cols;
-  std::size_t height = edges.rows;
-  
-  for( int y = 0 ; y < height ; ++y )
+  edgesPointsFromCanny( edgeCollection, edges, dx, dy, cv::Rect( 0, 0, edges.cols, edges.rows ) );
+}
+
+void edgesPointsFromCanny(
+        EdgePointCollection& edgeCollection,
+        const cv::Mat & edges,
+        const cv::Mat & dx,
+        const cv::Mat & dy,
+        const cv::Rect & region )
+{
+  for( int y = region.y ; y < region.y + region.height ; ++y )
   {
-    for( int x = 0 ; x < width ; ++x )
+    for( int x = region.x ; x < region.x + region.width ; ++x )
     {
       if ( edges.at<uchar>(y,x) == 255 )
       {
@@ -25,6 +25,14 @@ void edgesPointsFromCanny(
         const cv::Mat & dx,
         const cv::Mat & dy );
 
+// Only the edges of region.
+void edgesPointsFromCanny(
+        EdgePointCollection& edgeCollection,
+        const cv::Mat & edges,
+        const cv::Mat & dx,
+        const cv::Mat & dy,
+        const cv::Rect & region );
+
 } // namespace cctag
 
 #endif
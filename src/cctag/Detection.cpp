@@ -22,6 +22,7 @@
 #include <cctag/Fitting.hpp>
 #include <cctag/Types.hpp>
 #include <cctag/Canny.hpp>
+#include <cctag/StageRecord.hpp>
 #include <cctag/utils/Defines.hpp>
 #include <cctag/utils/Talk.hpp> // for DO_TALK macro
 #ifdef CCTAG_WITH_CUDA
@@ -57,6 +58,28 @@ namespace cctag
 
 namespace { using CandidatePtr = std::unique_ptr<Candidate>; }
 
+namespace {
+
+// Items of a prioritized range processed in parallel between two checks of the deadline.
+const std::size_t kDeadlineBlockSize = 32;
+
+// tbb::parallel_for over [0, count) of a range sorted by decreasing priority. With a
+// deadline, the range is processed in consecutive blocks, the deadline being checked
+// before each of them: the items skipped are those of lowest priority.
+template<typename Body>
+void parallelForByPriority(std::size_t count, Deadline* deadline, const Body& body)
+{
+  if( !deadline )
+  {
+    tbb::parallel_for(std::size_t(0), count, body);
+    return;
+  }
+  for( std::size_t begin = 0 ; begin < count && !deadline->reached() ; begin += kDeadlineBlockSize )
+    tbb::parallel_for(begin, std::min(begin + kDeadlineBlockSize, count), body);
+}
+
+} // anonymous namespace
+
 /* These are the CUDA pipelines that we instantiate for parallel processing.
  * We need at least one.
  * It is uncertain whether the CPU code can handle parallel pipe, but the CUDA
@@ -575,7 +598,8 @@ void cctagDetectionFromEdges(
         int pyramidLevel,
         float scale,
         const Parameters & providedParams,
-        cctag::logtime::Mgmt* durations )
+        cctag::logtime::Mgmt* durations,
+        Deadline* deadline )
 {
   const Parameters& params = Parameters::OverrideLoaded ?
     Parameters::Override : providedParams;
@@ -613,10 +637,12 @@ void cctagDetectionFromEdges(
   // The edge points lying on the inner ellipse and their voters (lying on the outer ellipse)
   // will be collected and constitute the initial data of a flow component.
   
+  // The seeds are sorted by decreasing number of votes: past the deadline, those
+  // with the fewest votes are skipped.
 #ifndef CCTAG_SERIALIZE
-  tbb::parallel_for(size_t(0), nSeedsToProcess, [&](int iSeed) {
+  parallelForByPriority(nSeedsToProcess, deadline, [&](size_t iSeed) {
 #else 
-  for(size_t iSeed=0 ; iSeed < nSeedsToProcess; ++iSeed)
+  for(size_t iSeed=0 ; iSeed < nSeedsToProcess && !(deadline && deadline->reached()); ++iSeed)
   {
 #endif
     assert( seeds[iSeed] );
@@ -641,10 +667,12 @@ void cctagDetectionFromEdges(
   CCTagVisualDebug::instance().initBackgroundImage(src);
   CCTagVisualDebug::instance().newSession( "completeFlowComponent" );
   
+  // vCandidateLoopOne is sorted by decreasing average vote: past the deadline, the
+  // candidates with the lowest one are skipped.
 #ifndef CCTAG_SERIALIZE
-  tbb::parallel_for(size_t(0), nFlowComponentToProcessLoopTwo, [&](size_t iCandidate) {
+  parallelForByPriority(nFlowComponentToProcessLoopTwo, deadline, [&](size_t iCandidate) {
 #else
-    for(size_t iCandidate=0 ; iCandidate < nFlowComponentToProcessLoopTwo; ++iCandidate)
+    for(size_t iCandidate=0 ; iCandidate < nFlowComponentToProcessLoopTwo && !(deadline && deadline->reached()); ++iCandidate)
     {
 #endif
       size_t runId = iCandidate;
@@ -677,10 +705,18 @@ void cctagDetectionFromEdges(
 
   const size_t candidateLoopTwoCount = vCandidateLoopTwo.size();
 
+  // The candidates were completed in any order: with a deadline, they are sorted
+  // again so that those with the lowest average vote are skipped.
+  if( deadline )
+  {
+    std::stable_sort(vCandidateLoopTwo.begin(), vCandidateLoopTwo.end(),
+      [](const Candidate& c1, const Candidate& c2) { return c1._averageReceivedVote > c2._averageReceivedVote; });
+  }
+
 #ifndef CCTAG_SERIALIZE
-  tbb::parallel_for(size_t(0), candidateLoopTwoCount, [&](size_t iCandidate) {
+  parallelForByPriority(candidateLoopTwoCount, deadline, [&](size_t iCandidate) {
 #else
-  for(size_t iCandidate=0 ; iCandidate < vCandidateLoopTwo.size(); ++iCandidate)
+  for(size_t iCandidate=0 ; iCandidate < vCandidateLoopTwo.size() && !(deadline && deadline->reached()); ++iCandidate)
 #endif
     cctagDetectionFromEdgesLoopTwoIteration(markers, edgeCollection, vCandidateLoopTwo, iCandidate,
       pyramidLevel, scale, params);
@@ -757,113 +793,51 @@ cctag::TagPipe* initCuda( int      pipeId,
 }
 #endif // CCTAG_WITH_CUDA
 
-/**
- * @brief Perform the CCTag detection on a gray scale image
- * 
- * @param[out] markers Detected markers. WARNING: only markers with status == 1 are valid ones. (status available via getStatus()) 
- * @param[in] frame A frame number. Can be anything (e.g. 0).
- * @param[in] imgGraySrc Gray scale input image.
- * @param[in] providedParams Contains all the parameters.
- * @param[in] bank CCTag bank.
- * @param[in] No longer used.
- */
-void cctagDetection(
+void cctagLocalization(
         CCTag::List& markers,
-        int          pipeId,
         std::size_t frame,
         const cv::Mat & imgGraySrc,
-        const Parameters & providedParams,
-        const cctag::CCTagMarkersBank & bank,
-        bool bDisplayEllipses,
-        cctag::logtime::Mgmt* durations )
-
+        ImagePyramid & imagePyramid,
+        const Parameters & params,
+        logtime::Mgmt* durations,
+        DetectionObserver* observer,
+        Deadline* deadline )
 {
-    using namespace cctag;
-    
-    const Parameters& params = Parameters::OverrideLoaded ?
-      Parameters::Override : providedParams;
+    imagePyramid.build( imgGraySrc,
+                        params._cannyThrLow,
+                        params._cannyThrHigh,
+                        &params );
 
-    if( durations ) durations->log( "start" );
-  
-    std::srand(1);
+    // see cctagDetection for YUYV input
+    const cv::Mat & imgGray = ( imgGraySrc.type() == CV_8UC2 ) ?
+        imagePyramid.getLevel(0)->getSrc() : imgGraySrc;
 
-#ifdef CCTAG_WITH_CUDA
-    bool cuda_allocates = params._useCuda;
-#else
-    bool cuda_allocates = false;
-#endif
-  
-    ImagePyramid imagePyramid( imgGraySrc.cols,
-                               imgGraySrc.rows,
-                               params._numberOfProcessedMultiresLayers,
-                               cuda_allocates );
-
-    cctag::TagPipe* pipe1 = nullptr;
-#ifdef CCTAG_WITH_CUDA
-    if( params._useCuda ) {
-        pipe1 = initCuda( pipeId,
-                          imgGraySrc.size().width,
-	                      imgGraySrc.size().height,
-	                      params,
-	                      durations );
-
-        if( durations ) durations->log( "after initCuda" );
-
-        assert( imgGraySrc.elemSize() == 1 );
-        assert( imgGraySrc.isContinuous() );
-        assert( imgGraySrc.type() == CV_8U );
-        unsigned char* pix = imgGraySrc.data;
-
-        pipe1->load( frame, pix );
-
-        if( durations ) {
-            cudaDeviceSynchronize();
-            durations->log( "after CUDA load" );
-        }
-
-        pipe1->tagframe( );
-
-        if( durations ) durations->log( "after CUDA stages" );
-    } else { // not params.useCuda
-#endif // CCTAG_WITH_CUDA
-
-        imagePyramid.build( imgGraySrc,
-                            params._cannyThrLow,
-                            params._cannyThrHigh,
-                            &params );
-
-#ifdef CCTAG_WITH_CUDA
-    } // not params.useCuda
-#endif // CCTAG_WITH_CUDA
-  
     if( durations ) durations->log( "before cctagMultiresDetection" );
 
     cctagMultiresDetection( markers,
-                            imgGraySrc,
+                            imgGray,
                             imagePyramid,
                             frame,
-                            pipe1,
+                            nullptr,
                             params,
-                            durations );
+                            durations,
+                            observer,
+                            deadline );
 
     if( durations ) durations->log( "after cctagMultiresDetection" );
+}
 
-#ifdef CCTAG_WITH_CUDA
-    if( pipe1 ) {
-        /* identification in CUDA requires a host-side nearby point struct
-         * in pinned memory for safe, non-blocking memcpy.
-         */
-        if( markers.size() > MAX_MARKER_FOR_IDENT ) {
-            std::cerr << __FILE__ << ":" << __LINE__ << std::endl
-              << "   Found more than " << MAX_MARKER_FOR_IDENT << " (" << markers.size() << ") markers" << endl;
-        }
-
-        for( CCTag& tag : markers ) {
-            tag.acquireNearbyPointMemory( pipe1->getId() );
-        }
-    }
-#endif // CCTAG_WITH_CUDA
-  
+void cctagIdentification(
+        CCTag::List& markers,
+        std::size_t frame,
+        const ImagePyramid & imagePyramid,
+        cctag::TagPipe* pipe1,
+        const Parameters & params,
+        const cctag::CCTagMarkersBank & bank,
+        logtime::Mgmt* durations,
+        DetectionObserver* observer,
+        Deadline* deadline )
+{
     CCTagVisualDebug::instance().initBackgroundImage(imagePyramid.getLevel(0)->getSrc());
 
     // Identification step
@@ -871,6 +845,11 @@ void cctagDetection(
     {
       CCTagVisualDebug::instance().resetMarkerIndex();
 
+        // With a deadline, the best candidates are identified first.
+        if( deadline ) {
+            markers.sort( []( const CCTag & a, const CCTag & b ) { return a.quality() > b.quality(); } );
+        }
+
         const int numTags  = markers.size();
 
 #ifdef CCTAG_WITH_CUDA
@@ -880,21 +859,60 @@ void cctagDetection(
 #endif // CCTAG_WITH_CUDA
 
         std::vector<std::vector<cctag::ImageCut> > vSelectedCuts( numTags );
-        int                          detected[ numTags ];
+        std::vector<int>             detected( numTags );
         int                          tagIndex = 0;
 
-        for( const CCTag& cctag : markers ) {
+        auto finishIdentification = [&]( CCTag& cctag, int index )
+        {
+            if( detected[index] == status::id_reliable ) {
+                detected[index] = cctag::identification::identify_step_2(
+                    index,
+                    cctag,
+                    vSelectedCuts[index],
+                    bank.getMarkers(),
+                    imagePyramid.getLevel(0)->getSrc(),
+                    pipe1,
+                    params );
+            }
+
+            cctag.setStatus( detected[index] );
+
+            if( observer ) observer->identified( frame, cctag );
+        };
+
+        // Past the deadline: the markers from index on, not identified, are dropped.
+        auto dropFrom = [&]( int index )
+        {
+            CCTag::List::iterator firstSkipped = markers.begin();
+            std::advance( firstSkipped, index );
+            markers.erase( firstSkipped, markers.end() );
+        };
+
+        for( CCTag& cctag : markers ) {
+            if( deadline && deadline->reached() ) {
+                break;
+            }
+
             detected[tagIndex] = cctag::identification::identify_step_1(
                 tagIndex,
                 cctag,
                 vSelectedCuts[tagIndex],
+                bank.getMarkers(),
                 imagePyramid.getLevel(0)->getSrc(),
                 params );
 
+            // The CPU has nothing to batch between the two steps: finish the
+            // tag right away so that its identity is known before the next one.
+            if( !pipe1 ) {
+                finishIdentification( cctag, tagIndex );
+            }
+
             tagIndex++;
         }
 
-        if( markers.size() != numTags ) {
+        if( tagIndex < numTags ) {
+            dropFrom( tagIndex );
+        } else if( markers.size() != numTags ) {
             cerr << __FILE__ << ":" << __LINE__ << " Number of markers has changed in identify_step_1" << endl;
         }
 
@@ -905,6 +923,12 @@ void cctagDetection(
             tagIndex = 0;
             int debug_num_calls = 0;
             for( CCTag& cctag : markers ) {
+                // The center of the markers not searched yet is not searched
+                // past the deadline.
+                if( deadline && deadline->reached() ) {
+                    break;
+                }
+
                 if( vSelectedCuts[tagIndex].size() <= 2 ) {
                     detected[tagIndex] = status::no_selected_cuts;
                 } else if( detected[tagIndex] == status::id_reliable ) {
@@ -932,33 +956,38 @@ void cctagDetection(
                 tagIndex++;
             }
             cudaDeviceSynchronize();
+
+            if( tagIndex < int( markers.size() ) ) {
+                dropFrom( tagIndex );
+            }
         }
 #endif // CCTAG_WITH_CUDA
 
-        tagIndex = 0;
+        if( pipe1 ) {
+            tagIndex = 0;
 
-        CCTag::List::iterator it = markers.begin();
-        while (it != markers.end())
-        {
-            CCTag & cctag = *it;
+            for( CCTag& cctag : markers ) {
+                if( deadline && deadline->reached() ) {
+                    break;
+                }
 
-            if( detected[tagIndex] == status::id_reliable ) {
-                detected[tagIndex] = cctag::identification::identify_step_2(
-                    tagIndex,
-                    cctag,
-                    vSelectedCuts[tagIndex],
-                    bank.getMarkers(),
-                    imagePyramid.getLevel(0)->getSrc(),
-                    pipe1,
-                    params );
-            }
+                finishIdentification( cctag, tagIndex );
 
-            cctag.setStatus( detected[tagIndex] );
-            ++it;
+                tagIndex++;
+            }
 
-            tagIndex++;
+            if( tagIndex < int( markers.size() ) ) {
+                dropFrom( tagIndex );
+            }
         }
         if( durations ) durations->log( "after cctag::identification::identify" );
+
+        // The signals of the cuts are the rectified ones at this point.
+        if( !params._recordDir.empty() ) {
+            std::stringstream recordName;
+            recordName << params._recordDir << "/frame" << frame << ".cuts";
+            CutRecord::write( recordName.str(), vSelectedCuts, frame );
+        }
     }
 
 #ifdef CCTAG_WITH_CUDA
@@ -995,4 +1024,276 @@ void cctagDetection(
     }
 }
 
+/**
+ * @brief Perform the CCTag detection on a gray scale image
+ * 
+ * @param[out] markers Detected markers. WARNING: only markers with status == 1 are valid ones. (status available via getStatus()) 
+ * @param[in] frame A frame number. Can be anything (e.g. 0).
+ * @param[in] imgGraySrc Gray scale input image (CV_8UC1, possibly a ROI), or a YUYV image (CV_8UC2).
+ * @param[in] providedParams Contains all the parameters.
+ * @param[in] bank CCTag bank.
+ * @param[in] No longer used.
+ * @param[in] observer Optional, notified of each marker as it is localized and identified.
+ */
+void cctagDetection(
+        CCTag::List& markers,
+        int          pipeId,
+        std::size_t frame,
+        const cv::Mat & imgGraySrc,
+        const Parameters & providedParams,
+        const cctag::CCTagMarkersBank & bank,
+        bool bDisplayEllipses,
+        cctag::logtime::Mgmt* durations,
+        DetectionObserver* observer,
+        Deadline* deadline )
+
+{
+    using namespace cctag;
+    
+    const Parameters& params = Parameters::OverrideLoaded ?
+      Parameters::Override : providedParams;
+
+    if( durations ) durations->log( "start" );
+  
+    std::srand(1);
+
+#ifdef CCTAG_WITH_CUDA
+    bool cuda_allocates = params._useCuda;
+#else
+    bool cuda_allocates = false;
+#endif
+
+    // YUYV input is reduced to its luma when the first pyramid level is filled;
+    // everything after that works on the gray image.
+    assert( imgGraySrc.type() == CV_8UC1 || imgGraySrc.type() == CV_8UC2 );
+    const bool packedLuma = imgGraySrc.type() == CV_8UC2;
+    cv::Mat imgGray = imgGraySrc;
+  
+    ImagePyramid imagePyramid( imgGraySrc.cols,
+                               imgGraySrc.rows,
+                               params._numberOfProcessedMultiresLayers,
+                               cuda_allocates );
+
+    cctag::TagPipe* pipe1 = nullptr;
+#ifdef CCTAG_WITH_CUDA
+    if( params._useCuda ) {
+        pipe1 = initCuda( pipeId,
+                          imgGraySrc.size().width,
+	                      imgGraySrc.size().height,
+	                      params,
+	                      durations );
+
+        if( durations ) durations->log( "after initCuda" );
+
+        // the CUDA upload needs a continuous gray plane
+        if( packedLuma ) {
+            cv::extractChannel( imgGraySrc, imgGray, 0 );
+        } else if( !imgGraySrc.isContinuous() ) {
+            imgGray = imgGraySrc.clone();
+        }
+        unsigned char* pix = imgGray.data;
+
+        pipe1->load( frame, pix );
+
+        if( durations ) {
+            cudaDeviceSynchronize();
+            durations->log( "after CUDA load" );
+        }
+
+        pipe1->tagframe( );
+
+        if( durations ) durations->log( "after CUDA stages" );
+    } else { // not params.useCuda
+#endif // CCTAG_WITH_CUDA
+
+        imagePyramid.build( imgGraySrc,
+                            params._cannyThrLow,
+                            params._cannyThrHigh,
+                            &params );
+        if( packedLuma ) {
+            imgGray = imagePyramid.getLevel(0)->getSrc();
+        }
+
+#ifdef CCTAG_WITH_CUDA
+    } // not params.useCuda
+#endif // CCTAG_WITH_CUDA
+  
+    if( durations ) durations->log( "before cctagMultiresDetection" );
+
+    cctagMultiresDetection( markers,
+                            imgGray,
+                            imagePyramid,
+                            frame,
+                            pipe1,
+                            params,
+                            durations,
+                            observer,
+                            deadline );
+
+    if( durations ) durations->log( "after cctagMultiresDetection" );
+
+#ifdef CCTAG_WITH_CUDA
+    if( pipe1 ) {
+        /* identification in CUDA requires a host-side nearby point struct
+         * in pinned memory for safe, non-blocking memcpy.
+         */
+        if( markers.size() > MAX_MARKER_FOR_IDENT ) {
+            std::cerr << __FILE__ << ":" << __LINE__ << std::endl
+              << "   Found more than " << MAX_MARKER_FOR_IDENT << " (" << markers.size() << ") markers" << endl;
+        }
+
+        for( CCTag& tag : markers ) {
+            tag.acquireNearbyPointMemory( pipe1->getId() );
+        }
+    }
+#endif // CCTAG_WITH_CUDA
+  
+    cctagIdentification( markers, frame, imagePyramid, pipe1, params, bank, durations, observer, deadline );
+}
+
+void cctagDetection(
+        CCTag::List& markers,
+        int          pipeId,
+        std::size_t frame,
+        const unsigned char* data,
+        int width,
+        int height,
+        std::size_t stride,
+        LumaFormat format,
+        const Parameters & providedParams,
+        const cctag::CCTagMarkersBank & bank,
+        logtime::Mgmt* durations,
+        DetectionObserver* observer,
+        Deadline* deadline )
+{
+    // Headers on the caller's buffer, no copy. For NV12 only the Y plane is used.
+    const int type = ( format == LumaFormat::YUYV ) ? CV_8UC2 : CV_8UC1;
+    const cv::Mat src( height, width, type, const_cast<unsigned char*>( data ), stride );
+
+    cctagDetection( markers, pipeId, frame, src, providedParams, bank, true, durations, observer, deadline );
+}
+
+namespace {
+
+// Smallest side, in pixels, of the coarsest level processed in a region.
+const int kMinRegionSideAtLevel = 32;
+
+// Forwards the markers found in a region in the coordinates of the image.
+class RegionObserver : public DetectionObserver
+{
+public:
+    RegionObserver( DetectionObserver* observer, const cv::Rect & region )
+        : _observer( observer ), _region( region )
+    { }
+
+    void localized( std::size_t frame, const CCTag & marker ) override
+    {
+        CCTag moved( marker );
+        moved.translate( _region.x, _region.y );
+        _observer->localized( frame, moved );
+    }
+
+    void identified( std::size_t frame, const CCTag & marker ) override
+    {
+        CCTag moved( marker );
+        moved.translate( _region.x, _region.y );
+        _observer->identified( frame, moved );
+    }
+
+private:
+    DetectionObserver* _observer;
+    const cv::Rect _region;
+};
+
+} // anonymous namespace
+
+void cctagDetection(
+        CCTag::List& markers,
+        std::size_t frame,
+        const cv::Mat & imgGraySrc,
+        const std::vector<cv::Rect> & regions,
+        int halo,
+        const Parameters & providedParams,
+        const cctag::CCTagMarkersBank & bank,
+        logtime::Mgmt* durations,
+        DetectionObserver* observer )
+{
+    const Parameters& params = Parameters::OverrideLoaded ?
+      Parameters::Override : providedParams;
+
+    if( durations ) durations->log( "start" );
+
+    std::srand(1);
+
+    // Enlarge the regions by the halo, clip them to the image, and merge
+    // the overlapping ones so that no pixel is processed twice.
+    const cv::Rect image( 0, 0, imgGraySrc.cols, imgGraySrc.rows );
+    std::vector<cv::Rect> rois;
+    for( const cv::Rect & region : regions ) {
+        const cv::Rect roi = cv::Rect( region.x - halo, region.y - halo,
+                                       region.width + 2*halo, region.height + 2*halo ) & image;
+        if( roi.area() > 0 ) {
+            rois.push_back( roi );
+        }
+    }
+
+    mergeOverlappingRegions( rois );
+
+    for( const cv::Rect & roi : rois ) {
+        // Small regions get fewer levels.
+        Parameters roiParams( params );
+        std::size_t levels = 1;
+        while( levels < params._numberOfProcessedMultiresLayers &&
+               std::min( roi.width, roi.height ) >> levels >= kMinRegionSideAtLevel ) {
+            ++levels;
+        }
+        roiParams._numberOfProcessedMultiresLayers = levels;
+
+        std::unique_ptr<RegionObserver> roiObserver;
+        if( observer ) {
+            roiObserver.reset( new RegionObserver( observer, roi ) );
+        }
+
+        ImagePyramid imagePyramid( roi.width, roi.height, levels, false );
+        CCTag::List roiMarkers;
+        cctagLocalization( roiMarkers, frame, imgGraySrc( roi ), imagePyramid, roiParams,
+                           durations, roiObserver.get() );
+        cctagIdentification( roiMarkers, frame, imagePyramid, nullptr, roiParams, bank,
+                             durations, roiObserver.get() );
+
+        for( CCTag & marker : roiMarkers ) {
+            marker.translate( roi.x, roi.y );
+        }
+        markers.transfer( markers.end(), roiMarkers );
+    }
+
+    markers.sort();
+}
+
+void cctagDetection(
+        CCTag::List& markers,
+        std::size_t frame,
+        const cv::Mat & imgGraySrc,
+        const cv::Mat & mask,
+        int halo,
+        const Parameters & providedParams,
+        const cctag::CCTagMarkersBank & bank,
+        logtime::Mgmt* durations,
+        DetectionObserver* observer )
+{
+    assert( mask.type() == CV_8UC1 && mask.size() == imgGraySrc.size() );
+
+    // findContours modifies its input with older OpenCV versions
+    std::vector<std::vector<cv::Point> > contours;
+    cv::findContours( mask.clone(), contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE );
+
+    std::vector<cv::Rect> regions;
+    regions.reserve( contours.size() );
+    for( const std::vector<cv::Point> & contour : contours ) {
+        regions.push_back( cv::boundingRect( contour ) );
+    }
+
+    cctagDetection( markers, frame, imgGraySrc, regions, halo, providedParams, bank, durations, observer );
+}
+
 } // namespace cctag
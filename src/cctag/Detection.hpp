@@ -12,6 +12,7 @@
 #include <cctag/CCTagMarkersBank.hpp>
 #include <cctag/Types.hpp>
 #include <cctag/Params.hpp>
+#include <cctag/utils/Deadline.hpp>
 #include <cctag/utils/LogTime.hpp>
 
 #include <opencv2/opencv.hpp>
@@ -24,6 +25,41 @@ namespace cctag {
 
 class EdgePoint;
 class EdgePointImage;
+class ImagePyramid;
+class TagPipe;
+
+/**
+ * @brief Receives the markers of a frame while cctagDetection is still running,
+ * so that a caller needing only positions, or only some ids, does not have to
+ * wait for the whole frame.
+ *
+ * The calls are made synchronously from the detecting thread and should
+ * return quickly. The marker is only valid during the call. Markers are
+ * reported before the final removal of duplicates, so a marker may be
+ * reported that is later merged with an overlapping one of better quality.
+ */
+class DetectionObserver
+{
+public:
+    virtual ~DetectionObserver() = default;
+
+    /**
+     * @brief Called once per candidate as soon as its outer ellipse and
+     * center are known in full resolution coordinates, before identification.
+     * When the original image is processed (Parameters::processedLevels()
+     * starts at 0), the candidates of the coarser levels are refined on its
+     * edges, so all of them are reported once every level has been searched;
+     * otherwise the candidates of a level are reported right after it.
+     */
+    virtual void localized( std::size_t frame, const CCTag & marker ) { }
+
+    /**
+     * @brief Called once per candidate when its identification is over;
+     * getStatus() tells whether it succeeded and id() is then valid.
+     * Not called when identification is disabled.
+     */
+    virtual void identified( std::size_t frame, const CCTag & marker ) { }
+};
 
 /**
  * @brief Perform the CCTag detection on a gray scale image. Cf. application/detection/main.cpp for example of usage.
@@ -31,10 +67,18 @@ class EdgePointImage;
  * @param[out] markers Detected markers. WARNING: only markers with status == 1 are valid ones. (status available via getStatus()) 
  * @param[in] pipeId Choose one of up to 3 parallel CUDA pipes
  * @param[in] frame A frame number. Can be anything (e.g. 0).
- * @param[in] imgGraySrc Gray scale input image.
+ * @param[in] imgGraySrc Gray scale input image (CV_8UC1, possibly a ROI), or a YUYV image (CV_8UC2).
  * @param[in] providedParams Contains all the parameters.
  * @param[in] bank CCTag bank.
  * @param[in] bDisplayEllipses No longer used.
+ * @param[in] observer Optional, notified of each marker as soon as it is localized
+ * and again when it is identified.
+ * @param[in,out] deadline Optional time budget. Once reached, the coarse levels
+ * having been searched first, the remaining levels are skipped, and so are the
+ * seeds with the fewest votes, the candidates with the lowest average vote, and
+ * the markers of lowest quality not yet identified, which are dropped: only
+ * complete markers are returned. deadline->truncated() then tells that the frame
+ * was not entirely processed.
  */
 void cctagDetection(
         CCTag::List& markers,
@@ -44,7 +88,132 @@ void cctagDetection(
         const Parameters & providedParams,
         const cctag::CCTagMarkersBank & bank,
         bool bDisplayEllipses = true,
-        logtime::Mgmt* durations = nullptr );
+        logtime::Mgmt* durations = nullptr,
+        DetectionObserver* observer = nullptr,
+        Deadline* deadline = nullptr );
+
+/**
+ * @brief Layouts of the raw input buffers accepted by cctagDetection.
+ */
+enum class LumaFormat
+{
+    Gray,   ///< 8 bits per pixel
+    YUYV,   ///< packed 4:2:2, 2 bytes per pixel; only the luma is read
+    NV12    ///< the buffer points to the Y plane; the chroma plane is not read
+};
+
+/**
+ * @brief Perform the CCTag detection on an image in caller-owned memory, without
+ * copying it into a cv::Mat first. The rows may be padded (stride >= bytes per row),
+ * so a camera buffer or a region of interest of a larger image can be passed as is.
+ * The luma of YUYV input is extracted while building the first pyramid level.
+ * 
+ * @param[out] markers Detected markers.
+ * @param[in] pipeId Choose one of up to 3 parallel CUDA pipes
+ * @param[in] frame A frame number. Can be anything (e.g. 0).
+ * @param[in] data First pixel of the image.
+ * @param[in] width Width in pixels.
+ * @param[in] height Height in pixels.
+ * @param[in] stride Distance in bytes between the starts of two rows.
+ * @param[in] format Layout of the pixels.
+ * @param[in] providedParams Contains all the parameters.
+ * @param[in] bank CCTag bank.
+ * @param[in] observer Optional, see the cv::Mat overload.
+ * @param[in,out] deadline Optional, see the cv::Mat overload.
+ */
+void cctagDetection(
+        CCTag::List& markers,
+        int          pipeId,
+        std::size_t frame,
+        const unsigned char* data,
+        int width,
+        int height,
+        std::size_t stride,
+        LumaFormat format,
+        const Parameters & providedParams,
+        const cctag::CCTagMarkersBank & bank,
+        logtime::Mgmt* durations = nullptr,
+        DetectionObserver* observer = nullptr,
+        Deadline* deadline = nullptr );
+
+/**
+ * @brief Perform the CCTag detection only in regions of interest, e.g. where a
+ * calibration board or an upstream detector says markers are. Pyramids, Canny,
+ * voting and the ellipse search are computed on the regions only, so the cost
+ * follows their area rather than the size of the image. Regions that overlap
+ * once enlarged by the halo are processed as one. The markers are returned in
+ * the coordinates of imgGraySrc, as are those given to the observer.
+ * The regions are always processed on the CPU.
+ *
+ * @param[out] markers Detected markers, see the full frame overload.
+ * @param[in] frame A frame number. Can be anything (e.g. 0).
+ * @param[in] imgGraySrc Gray scale input image (CV_8UC1), or a YUYV image (CV_8UC2).
+ * @param[in] regions Where the markers may be.
+ * @param[in] halo Margin in pixels added around each region, at least the radius
+ * of the largest expected marker so that a marker overlapping a region is entirely
+ * processed.
+ * @param[in] providedParams Contains all the parameters.
+ * @param[in] bank CCTag bank.
+ * @param[in] observer Optional, see the full frame overload.
+ */
+void cctagDetection(
+        CCTag::List& markers,
+        std::size_t frame,
+        const cv::Mat & imgGraySrc,
+        const std::vector<cv::Rect> & regions,
+        int halo,
+        const Parameters & providedParams,
+        const cctag::CCTagMarkersBank & bank,
+        logtime::Mgmt* durations = nullptr,
+        DetectionObserver* observer = nullptr );
+
+/**
+ * @brief Same as above, the regions being the bounding boxes of the connected
+ * components of mask (CV_8UC1, the size of imgGraySrc, non-zero where the
+ * markers may be).
+ */
+void cctagDetection(
+        CCTag::List& markers,
+        std::size_t frame,
+        const cv::Mat & imgGraySrc,
+        const cv::Mat & mask,
+        int halo,
+        const Parameters & providedParams,
+        const cctag::CCTagMarkersBank & bank,
+        logtime::Mgmt* durations = nullptr,
+        DetectionObserver* observer = nullptr );
+
+/**
+ * @brief First half of cctagDetection on the CPU: builds the image pyramid and
+ * localizes the candidate markers on every level. imagePyramid must have the
+ * size of the image; it is needed by cctagIdentification.
+ */
+void cctagLocalization(
+        CCTag::List& markers,
+        std::size_t frame,
+        const cv::Mat & imgGraySrc,
+        ImagePyramid & imagePyramid,
+        const Parameters & params,
+        logtime::Mgmt* durations = nullptr,
+        DetectionObserver* observer = nullptr,
+        Deadline* deadline = nullptr );
+
+/**
+ * @brief Second half of cctagDetection: identifies the localized markers, then
+ * removes the overlapping ones. pipe is null on the CPU. With a deadline, the
+ * markers are identified by decreasing quality and those left when it is
+ * reached are dropped.
+ */
+void cctagIdentification(
+        CCTag::List& markers,
+        std::size_t frame,
+        const ImagePyramid & imagePyramid,
+        cctag::TagPipe* pipe,
+        const Parameters & params,
+        const cctag::CCTagMarkersBank & bank,
+        logtime::Mgmt* durations = nullptr,
+        DetectionObserver* observer = nullptr,
+        Deadline* deadline = nullptr );
 
 void cctagDetectionFromEdges(
         CCTag::List&            markers,
@@ -55,7 +224,8 @@ void cctagDetectionFromEdges(
         int pyramidLevel,
         float scale,
         const Parameters & providedParams,
-        logtime::Mgmt* durations );
+        logtime::Mgmt* durations,
+        Deadline* deadline = nullptr );
 
 void createImageForVoteResultDebug(
         const cv::Mat & src,
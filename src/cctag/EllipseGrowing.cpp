@@ -56,7 +56,7 @@ bool initMarkerCenter(cctag::Point2d<Eigen::Vector3f> & markerCenter,
 
         for(const Point2d<Eigen::Vector3f>& pt : markerPoints[0])
         {
-          CCTagVisualDebug::instance().drawPoint(pt, cctag::color_red);
+          CCTAG_VISUAL_DEBUG_HOOK(drawPoint(pt, cctag::color_red));
         }
       }
       else
@@ -174,7 +174,7 @@ bool addCandidateFlowtoCCTag(EdgePointCollection& edgeCollection,
         }
         else
         {
-          CCTagFileDebug::instance().outputFlowComponentAssemblingInfos(PTS_OUT_WHILE_ASSEMBLING);
+          CCTAG_FILE_DEBUG_HOOK(outputFlowComponentAssemblingInfos(PTS_OUT_WHILE_ASSEMBLING));
           cctagPoints.clear();
 
           for (EdgePoint* point : vProcessedEdgePoint)
@@ -195,7 +195,7 @@ bool addCandidateFlowtoCCTag(EdgePointCollection& edgeCollection,
   if (float(nGradientOut) / float(nAddedPoint) > 0.5f)
   {
     cctagPoints.clear();
-    CCTagFileDebug::instance().outputFlowComponentAssemblingInfos(BAD_GRAD_WHILE_ASSEMBLING);
+    CCTAG_FILE_DEBUG_HOOK(outputFlowComponentAssemblingInfos(BAD_GRAD_WHILE_ASSEMBLING));
     return false;
   }
   else
@@ -26,7 +26,9 @@
 #include <boost/accumulators/statistics/variance.hpp>
 #include <boost/assert.hpp>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <vector>
 
 #include <tbb/tbb.h>
@@ -36,6 +38,101 @@
 namespace cctag {
 namespace identification {
 
+/**
+ * @brief Distance of a rectified 1D signal to the profile of every id of the bank,
+ * as described in [Orazio et al. 2011].
+ *
+ * @param[out] distances distance to the profile of every id of rrBank
+ * @param[in] rrBank Set of vector of radius ratio describing the 1D profile of the cctag library
+ * @param[in] imgSig rectified 1D signal
+ * @param[in] beginSig position of the first sample of imgSig along the cut (in [0 1])
+ * @param[in] endSig position of the last sample of imgSig along the cut (in [0 1])
+ */
+static void orazioDistances(
+        std::vector<float> & distances,
+        const RadiusRatioBank & rrBank,
+        const std::vector<float> & imgSig,
+        float beginSig,
+        float endSig)
+{
+  using namespace boost::accumulators;
+
+  // compute some statitics
+  accumulator_set< float, features< /*tag::median,*/ tag::variance > > acc;
+  // Put the image signal into the accumulator
+  acc = std::for_each( imgSig.begin()+30, imgSig.end(), acc ); // todo@Lilian +30
+
+  // Mean
+  const float medianSig = boost::accumulators::mean( acc );
+  
+  // or median
+  //const float medianSig = computeMedian( imgSig );
+
+  const float varSig = boost::accumulators::variance( acc );
+
+  accumulator_set< float, features< tag::mean > > accInf;
+  accumulator_set< float, features< tag::mean > > accSup;
+  
+  bool doAccumulate = false;
+  for(float i : imgSig)
+  {
+    if ( (!doAccumulate) && ( i < medianSig ) )
+      doAccumulate = true;
+      
+    if (doAccumulate)
+    {
+      if ( i < medianSig )
+        accInf( i );
+      else
+        accSup( i );
+    }
+  }
+  const float muw = boost::accumulators::mean( accSup );
+  const float mub = boost::accumulators::mean( accInf );
+
+  // Find the nearest ID in rrBank
+  const float stepX = (endSig - beginSig) / ( imgSig.size() - 1.f );
+
+  // vector of 1 or -1 values
+  std::vector<float> digit( imgSig.size() );
+
+#ifdef GRIFF_DEBUG
+  assert( rrBank.size() > 0 );
+#endif // GRIFF_DEBUG
+  // Loop over imgSig values, compute and sum the difference between 
+  // imgSig and digit (i.e. generated profile)
+  distances.resize( rrBank.size() );
+  for( std::size_t idc = 0; idc < rrBank.size(); ++idc )
+  {
+    // Compute the idc-th profile from the radius ratio
+    // todo@Lilian: to be pre-computed
+    float x = beginSig;
+    for(float & i : digit)
+    {
+      std::ssize_t ldum = 0;
+      for(float j : rrBank[idc])
+      {
+        if( 1.f / j <= x )
+        {
+          ++ldum;
+        }
+      }
+      // set odd value to -1 and even value to 1
+      i = - ( ldum % 2 ) * 2 + 1;
+      
+      x += stepX;
+    }
+
+    // compute distance to profile
+    float distance = 0;
+    for( std::size_t i = 0 ; i < imgSig.size() ; ++i )
+    {
+      distance += dis( imgSig[i], digit[i], mub, muw, varSig );
+    }
+    distances[idc] = distance;
+  }
+}
+
 /**
  * @brief Read and identify a 1D rectified image signal.
  * 
@@ -82,81 +179,12 @@ bool orazioDistanceRobust(
       idSet.reserve(sizeIds);
 
       // imgSig contains the rectified 1D signal.
-      //boost::numeric::ublas::vector<float> imgSig( cuts.front().imgSignal().size() );
-      const std::vector<float> & imgSig = cut.imgSignal();
-
-      // compute some statitics
-      accumulator_set< float, features< /*tag::median,*/ tag::variance > > acc;
-      // Put the image signal into the accumulator
-      acc = std::for_each( imgSig.begin()+30, imgSig.end(), acc ); // todo@Lilian +30
-
-      // Mean
-      const float medianSig = boost::accumulators::mean( acc );
-      
-      // or median
-      //const float medianSig = computeMedian( imgSig );
-
-      const float varSig = boost::accumulators::variance( acc );
-
-      accumulator_set< float, features< tag::mean > > accInf;
-      accumulator_set< float, features< tag::mean > > accSup;
-      
-      bool doAccumulate = false;
-      for(float i : imgSig)
-      {
-        if ( (!doAccumulate) && ( i < medianSig ) )
-          doAccumulate = true;
-          
-        if (doAccumulate)
-        {
-          if ( i < medianSig )
-            accInf( i );
-          else
-            accSup( i );
-        }
-      }
-      const float muw = boost::accumulators::mean( accSup );
-      const float mub = boost::accumulators::mean( accInf );
-
-      // Find the nearest ID in rrBank
-      const float stepX = (cut.endSig() - cut.beginSig()) / ( imgSig.size() - 1.f );
+      std::vector<float> distances;
+      orazioDistances( distances, rrBank, cut.imgSignal(), cut.beginSig(), cut.endSig() );
 
-      // vector of 1 or -1 values
-      std::vector<float> digit( imgSig.size() );
-
-  #ifdef GRIFF_DEBUG
-      assert( rrBank.size() > 0 );
-  #endif // GRIFF_DEBUG
-      // Loop over imgSig values, compute and sum the difference between 
-      // imgSig and digit (i.e. generated profile)
       for( std::size_t idc = 0; idc < rrBank.size(); ++idc )
       {
-        // Compute the idc-th profile from the radius ratio
-        // todo@Lilian: to be pre-computed
-        float x = cut.beginSig();
-        for(float & i : digit)
-        {
-          std::ssize_t ldum = 0;
-          for(float j : rrBank[idc])
-          {
-            if( 1.f / j <= x )
-            {
-              ++ldum;
-            }
-          }
-          // set odd value to -1 and even value to 1
-          i = - ( ldum % 2 ) * 2 + 1;
-          
-          x += stepX;
-        }
-
-        // compute distance to profile
-        float distance = 0;
-        for( std::size_t i = 0 ; i < imgSig.size() ; ++i )
-        {
-          distance += dis( imgSig[i], digit[i], mub, muw, varSig );
-        }
-        const float v = std::exp( -distance ); // todo: remove the exp()
+        const float v = std::exp( -distances[idc] ); // todo: remove the exp()
         sortedId[v] = idc;
       }
 
@@ -190,6 +218,103 @@ bool orazioDistanceRobust(
   return true;
 }
 
+/**
+ * @brief Id with the most votes of orazioDistanceRobust.
+ *
+ * @param[out] id most voted id
+ * @param[out] score mean probability of its votes, 0 if no cut voted
+ * @param[in] vScore votes of orazioDistanceRobust
+ */
+static void mostVotedId( MarkerID & id, float & score, const std::vector<std::list<float> > & vScore )
+{
+  std::size_t maxSize = 0;
+  int i = 0;
+  int iMax = 0;
+
+  for(const std::list<float> & lResult : vScore)
+  {
+    if (lResult.size() > maxSize)
+    {
+      iMax = i;
+      maxSize = lResult.size();
+    }
+    ++i;
+  }
+
+#ifdef GRIFF_DEBUG
+  assert( vScore.size() > 0 );
+  assert( vScore.size() > iMax );
+#endif // GRIFF_DEBUG
+  id = iMax;
+  score = 0;
+  if( maxSize == 0 )
+    return;
+  for(const float & proba : vScore[iMax])
+  {
+    score += proba;
+  }
+  score /= vScore[iMax].size();
+}
+
+// Ids whose profile is that much farther from the barcode than the nearest one are
+// not considered by the vote of the cuts; a sample on the wrong side of an edge costs
+// about 2.
+static const float kBarCodeTieDistance = 2.f;
+
+void barCodeIdentification(
+        MarkerID & id,
+        float & score,
+        IdSet & idSet,
+        const RadiusRatioBank & rrBank,
+        const std::vector<float> & barCode,
+        const std::vector<cctag::ImageCut> & cuts,
+        float minIdentProba,
+        std::size_t sizeIds)
+{
+  BOOST_ASSERT( cuts.size() > 0 && rrBank.size() > 0 );
+
+  // A. Score the whole bank once, against the barcode.
+  std::vector<float> distances;
+  orazioDistances( distances, rrBank, barCode, cuts.front().beginSig(), cuts.front().endSig() );
+
+  std::vector<std::size_t> order( rrBank.size() );
+  for( std::size_t idc = 0 ; idc < order.size() ; ++idc )
+    order[idc] = idc;
+  std::sort( order.begin(), order.end(), [&]( std::size_t a, std::size_t b ) {
+    return distances[a] < distances[b];
+  } );
+
+  idSet.clear();
+  for( std::size_t k = 0 ; k < std::min( sizeIds, order.size() ) ; ++k )
+    idSet.emplace_back( MarkerID( order[k] ), std::exp( -distances[order[k]] ) );
+
+  id = MarkerID( order.front() );
+  score = std::exp( -distances[order.front()] );
+
+  // B. Tie-break: the cuts vote between the ids about as near as the best one.
+  RadiusRatioBank ties;
+  for( const std::size_t idc : order )
+  {
+    if( distances[idc] > distances[order.front()] + kBarCodeTieDistance )
+      break;
+    ties.push_back( rrBank[idc] );
+  }
+  if( ties.size() < 2 )
+    return;
+
+  // The score stays the probability of the barcode, now for the id the cuts voted for;
+  // the nearest id is kept if no cut voted.
+  std::vector<std::list<float> > vScore( ties.size() );
+  orazioDistanceRobust( vScore, ties, cuts, minIdentProba );
+  MarkerID iTie;
+  float voteScore;
+  mostVotedId( iTie, voteScore, vScore );
+  if( vScore[iTie].empty() )
+    return;
+  id = MarkerID( order[iTie] );
+  score = std::exp( -distances[order[iTie]] );
+}
+
 void createRectifiedCutImage(const std::vector<ImageCut> & vCuts, cv::Mat & output)
 {
   output = cv::Mat(vCuts.size(), vCuts.front().imgSignal().size(), CV_8UC1);
@@ -455,43 +580,6 @@ void cutInterpolated(
   }
 }
 
-/**
- * @brief Collect signals (image cuts) from center to outer ellipse points
- * 
- * @param[out] cuts collected cuts
- * @param[in] src source gray scale image (uchar)
- * @param[in] center outer ellipse center
- * @param[in] outerPoints outer ellipse points
- * @param[in] nSamplesInCut number of samples collected in an image cut
- * @param[in] beginSig offset from which the signal must be collected (in [0 1])
- */
-void collectCuts(
-        std::vector<cctag::ImageCut> & cuts,
-        const cv::Mat & src,
-        const cctag::Point2d<Eigen::Vector3f> & center,
-        const std::vector< cctag::DirectedPoint2d<Eigen::Vector3f> > & outerPoints,
-        std::size_t nSamplesInCut,
-        float beginSig )
-{
-  // Collect all the 1D image signals from center to the outer points.
-  cuts.reserve( outerPoints.size() );
-  for( const cctag::DirectedPoint2d<Eigen::Vector3f> & outerPoint : outerPoints )
-  {
-    // Here only beginSig is set based on the input argument beginSig while endSig is set to 1.f as 
-    // any type of cctags encodes, by construction, a 1D bar-code until the outer ellipse (image 
-    // of the unit circle).
-    cuts.emplace_back(center, outerPoint, beginSig, 1.f, nSamplesInCut );
-    cctag::ImageCut & cut = cuts.back();
-    cutInterpolated( cut, src);
-    // Remove the cut from the vector if out of the image bounds.
-    if ( cut.outOfBounds() )
-    {
-      CCTAG_COUT_VAR_OPTIM(cut.outOfBounds());
-      cuts.pop_back();
-    }
-  }
-}
-
 /**
  * @brief Compute a cost (score) for the cut selection based on the variance and the gradient orientation
  * of the outer point (cut.stop()) over all outer points.
@@ -529,72 +617,110 @@ float costSelectCutFun(
   return ndir - alpha * sumVar;
 }
 
+// Whether cutInterpolated can read the pixel (x,y) of src.
+static bool inCutBounds( float x, float y, const cv::Mat & src )
+{
+  return x >= 1.f && x < src.cols-1 && y >= 1.f && y < src.rows-1;
+}
+
+// Only one sample out of kSparseCutStride is read to estimate the variance of a cut
+// before the selection.
+static const std::size_t kSparseCutStride = 5;
+
 /**
  * @brief Select a subset of image cuts appropriate for the image center optimisation.
  * This selection aims at "maximizing" the variance of the image signal over all the 
  * selected cuts while ensuring a "good" distribution of the selected outer points
  * around the imaged center.
+ * The cuts are collected lazily: the variance of every cut is estimated on a sparse
+ * subsample of its signal, and only the selected cuts are fully interpolated and have
+ * their outer point refined.
  *
  * @param[out] vSelectedCuts selected image cuts
  * @param[in] selectSize number of desired cuts to select
- * @param[in] collectedCuts all the collected cuts
+ * @param[in] outerEllipse outer ellipse, the cuts start from its center
+ * @param[in] outerPoints outer ellipse points, where the cuts stop
  * @param[in] src source gray scale image (uchar)
+ * @param[in] nSamplesInCut number of samples collected in an image cut
+ * @param[in] beginSig offset from which the signal must be collected (in [0 1])
+ * @return number of cuts within the image bounds
  */
-void selectCutCheapUniform( std::vector< cctag::ImageCut > & vSelectedCuts,
+static std::size_t selectCutLazyUniform( std::vector< cctag::ImageCut > & vSelectedCuts,
         std::size_t selectSize,
         const cctag::numerical::geometry::Ellipse & outerEllipse,
-        std::vector<cctag::ImageCut> & collectedCuts,
+        const std::vector< cctag::DirectedPoint2d<Eigen::Vector3f> > & outerPoints,
         const cv::Mat & src,
+        const std::size_t nSamplesInCut,
+        const float beginSig,
         const float scale,
         const size_t numSamplesOuterEdgePointsRefinement)
 {
-  using namespace boost::numeric;
   using namespace boost::accumulators;
   using namespace cctag::numerical;
 
-  selectSize = std::min( selectSize, collectedCuts.size() );
+  const Point2d<Eigen::Vector3f> & center = outerEllipse.center();
 
+  // Variance of the cuts within the image bounds, estimated on a sparse subsample
+  // of the samples cutInterpolated would read.
+  std::vector<std::size_t> inBounds;
   std::vector<float> varCuts;
-  varCuts.reserve(collectedCuts.size());
-  for( const cctag::ImageCut & cut : collectedCuts )
+  inBounds.reserve(outerPoints.size());
+  varCuts.reserve(outerPoints.size());
+  for( std::size_t iPoint = 0 ; iPoint < outerPoints.size() ; ++iPoint )
   {
+    const DirectedPoint2d<Eigen::Vector3f> & outerPoint = outerPoints[iPoint];
+    const float xStart = center.x() + ( outerPoint.x() - center.x() ) * beginSig;
+    const float yStart = center.y() + ( outerPoint.y() - center.y() ) * beginSig;
+    if ( !inCutBounds( xStart, yStart, src ) || !inCutBounds( outerPoint.x(), outerPoint.y(), src ) )
+      continue;
+
+    const float stepX = ( outerPoint.x() - xStart ) / ( nSamplesInCut - 1.f );
+    const float stepY = ( outerPoint.y() - yStart ) / ( nSamplesInCut - 1.f );
     accumulator_set< float, features< tag::variance > > acc;
-    acc = std::for_each( cut.imgSignal().begin(), cut.imgSignal().end(), acc );
+    for( std::size_t i = 0 ; i < nSamplesInCut ; i += kSparseCutStride )
+      acc( getPixelBilinear( src, xStart + i * stepX, yStart + i * stepY ) );
+
+    inBounds.push_back( iPoint );
     varCuts.push_back( variance( acc ) );
   }
-  
-  const float varMax = *std::max_element(varCuts.begin(),varCuts.end());
-  
+
   vSelectedCuts.clear();
-  vSelectedCuts.reserve(selectSize);
+  if ( inBounds.empty() )
+    return 0;
+
+  selectSize = std::min( selectSize, inBounds.size() );
   
-  std::size_t sharpSize = 0;
+  const float varMax = *std::max_element(varCuts.begin(),varCuts.end());
   
   // Initialize vector of indices of sharp cuts
   std::vector<std::size_t> indToAdd;
   indToAdd.reserve(varCuts.size());
-  
   for(std::size_t iCut = 0 ; iCut < varCuts.size() ; ++iCut)
   {
-    ImageCut & cut = collectedCuts[iCut];
-    cut.stop() = DirectedPoint2d<Eigen::Vector3f>(pointOnEllipse( outerEllipse, cut.stop() ), cut.stop().dX(), cut.stop().dY() );
-    if ( outerEdgeRefinement(cut, src, scale, numSamplesOuterEdgePointsRefinement) )
-      if ( varCuts[iCut]/varMax > 0.5f )
-        indToAdd.push_back(iCut);
+    if ( varCuts[iCut]/varMax > 0.5f )
+      indToAdd.push_back(inBounds[iCut]);
   }
   
   const float step = std::max(1.f, (float) indToAdd.size() / (float) ( selectSize ));
   
+  vSelectedCuts.reserve(selectSize);
   for(std::size_t k=0 ; ; ++k)
   {
     if ( ( std::size_t(k*step) < indToAdd.size() ) && ( vSelectedCuts.size() < selectSize) )
     {
-      ImageCut & cut = collectedCuts[indToAdd[std::size_t(k*step)]];
-      vSelectedCuts.push_back( cut );
+      // Only the selected cuts are collected.
+      vSelectedCuts.emplace_back( center, outerPoints[indToAdd[std::size_t(k*step)]], beginSig, 1.f, nSamplesInCut );
+      ImageCut & cut = vSelectedCuts.back();
+      cutInterpolated( cut, src );
+      cut.stop() = DirectedPoint2d<Eigen::Vector3f>(pointOnEllipse( outerEllipse, cut.stop() ), cut.stop().dX(), cut.stop().dY() );
+      if ( cut.outOfBounds() || !outerEdgeRefinement(cut, src, scale, numSamplesOuterEdgePointsRefinement) )
+        vSelectedCuts.pop_back();
     }else{
       break;
     }
   }
+
+  return inBounds.size();
 }
 
 /* Ugly -> perform an iterative optimization*/
@@ -804,6 +930,7 @@ void computeHomographyFromEllipseAndImagedCenter(
  * @param[in] src source image
  * @param[in] ellipse outer ellipse (todo: is that already in the cctag object?)
  * @param[in] params parameters of the cctag algorithm
+ * @param[in] initialNeighbourSize size of the first search neighbourhood, 0 for the default
  * @return true if the optimization has found a solution, false otherwise.
  */
 bool refineConicFamilyGlob(
@@ -816,7 +943,9 @@ bool refineConicFamilyGlob(
         const cctag::numerical::geometry::Ellipse & outerEllipse,
         const cctag::Parameters & params,
         cctag::NearbyPoint* cctag_pointer_buffer,
-        float & residual)
+        float & residual,
+        float initialNeighbourSize,
+        std::vector<float> * medianBarCode)
 {
     using namespace cctag::numerical;
 
@@ -851,6 +980,9 @@ bool refineConicFamilyGlob(
 
         // The neighbourhood size is 0.20*max(ellipse.a(),ellipse.b()), i.e. the max ellipse semi-axis
         float neighbourSize = params._imagedCenterNeighbourSize;
+        // unless the starting point is known to be close, e.g. from the previous frame
+        if ( initialNeighbourSize > 0.f )
+          neighbourSize = std::min( neighbourSize, initialNeighbourSize );
 
         std::size_t gridNSample = params._imagedCenterNGridSample; // todo: check must be odd 
 
@@ -954,6 +1086,10 @@ bool refineConicFamilyGlob(
     // Final normalized residual
     
     residual = sqrt(residual)/magnitude;
+
+    if ( medianBarCode )
+      medianBarCode->swap( barCode );
+
     if ( residual > 2.7f )
       return false;
     else
@@ -1006,7 +1142,7 @@ bool imageCenterOptimizationGlob(
     // For all points nearby the center ////////////////////////////////////////
     for(const cctag::Point2d<Eigen::Vector3f> & point : nearbyPoints)
     {
-        CCTagVisualDebug::instance().drawPoint( point , cctag::color_green );
+        CCTAG_VISUAL_DEBUG_HOOK(drawPoint( point , cctag::color_green ));
 
         // B. Compute the homography so that the back projection of 'point' is the
         // center, i.e. [0;0;1], and the back projected ellipse is the unit circle
@@ -1153,6 +1289,191 @@ float costFunctionGlob(
   }
 }
 
+/**
+ * @brief Set from where the rectified 1D signal should be read.
+ * In fact, the white area located inside the inner ellipse does not hold
+ * any information neither for the optimization nor for the reading.
+ * The "signal of interest" is located between the returned value and 1.f (endSig in ImageCut)
+ */
+static float signalBegin( const cctag::Parameters & params )
+{
+  float startSig = 0.f;
+  if (params._nCrowns == 3)
+  {
+    // Signal begin at 25% of the unit radius (for 3 black rings markers).
+    // startOffset
+    startSig = 1 - (2*params._nCrowns-1)*0.15;
+  }
+  else if (params._nCrowns == 4)
+  {
+    startSig = 0.26; // todo@Lilian
+  }
+  else
+  {
+    CCTAG_COUT("Error : unknown number of crowns");
+  }
+  return startSig;
+}
+
+// Cuts read by plausibleSignal.
+static const std::size_t kPlausibilityCuts = 8;
+// Minimal median contrast of the cuts; getPixelBilinear halves the gray levels.
+static const float kMinCutContrast = 4.f;
+// The white center must be brighter than the black outer ring by this part of the contrast.
+static const float kMinPolarity = 0.25f;
+// Hysteresis, relative to the contrast, of the binarization counting the ring edges.
+static const float kEdgeHysteresis = 0.1f;
+// The edges are only counted, and located, if the thinnest ring of the bank is that wide
+// in pixels along the minor axis.
+static const float kMinRingWidth = 2.f;
+// Tolerance on the median number of edges and on the median distance, relative to the
+// outer radius, between the edges and the radii of the nearest marker of the bank. Loose
+// enough for the offset of the imaged center under perspective.
+static const float kMaxEdgeCountError = 2.f;
+static const float kMaxBarcodeError = 0.15f;
+
+bool plausibleSignal(
+  const cctag::numerical::geometry::Ellipse & ellipse,
+  const std::vector< cctag::DirectedPoint2d<Eigen::Vector3f> > & outerPoints,
+  const RadiusRatioBank & rrBank,
+  const cv::Mat & src,
+  const cctag::Parameters & params)
+{
+  if( rrBank.empty() || rrBank.front().empty() || outerPoints.size() < kPlausibilityCuts )
+    return true;
+
+  // Geometry of the bank: the white disk at the center is at least innerRadius wide, the
+  // black outer ring begins at outerRadius at most and no ring is thinner than minGap.
+  float innerRadius = 1.f;
+  float outerRadius = 0.f;
+  float minGap = 1.f;
+  for( const std::vector<float> & radiusRatios : rrBank )
+  {
+    float previous = 0.f;
+    for( const float radiusRatio : radiusRatios )
+    {
+      minGap = std::min( minGap, 1.f / radiusRatio - previous );
+      previous = 1.f / radiusRatio;
+    }
+    minGap = std::min( minGap, 1.f - previous );
+    innerRadius = std::min( innerRadius, 1.f / radiusRatios.front() );
+    outerRadius = std::max( outerRadius, previous );
+  }
+  const float ringBegin = outerRadius + 0.25f * ( 1.f - outerRadius );
+  const float ringEnd = 1.f - 0.25f * ( 1.f - outerRadius );
+  const std::size_t nEdges = rrBank.front().size();
+
+  const std::size_t nSamples = params._sampleCutLength;
+  const float stepX = 1.f / ( nSamples - 1.f );
+  const bool locateEdges = minGap * std::min( ellipse.a(), ellipse.b() ) >= kMinRingWidth
+                        && minGap / stepX >= 2.f;
+
+  std::vector<float> contrasts;
+  std::vector<float> edgeCounts;
+  std::vector< std::vector<float> > vEdges;
+  std::size_t polarityAgree = 0;
+  const float step = float( outerPoints.size() ) / kPlausibilityCuts;
+  for( std::size_t iCut = 0 ; iCut < kPlausibilityCuts ; ++iCut )
+  {
+    cctag::ImageCut cut( ellipse.center(), outerPoints[std::size_t( iCut * step )], 0.f, 1.f, nSamples );
+    cutInterpolated( cut, src );
+    if( cut.outOfBounds() )
+      continue;
+
+    const std::vector<float> & imgSig = cut.imgSignal();
+    const auto minMax = std::minmax_element( imgSig.begin(), imgSig.end() );
+    const float contrast = *minMax.second - *minMax.first;
+    contrasts.push_back( contrast );
+
+    float centerSum = 0.f, ringSum = 0.f;
+    std::size_t centerCount = 0, ringCount = 0;
+    for( std::size_t i = 0 ; i < nSamples ; ++i )
+    {
+      const float x = i * stepX;
+      if( x <= 0.5f * innerRadius )
+      {
+        centerSum += imgSig[i];
+        ++centerCount;
+      }
+      else if( x >= ringBegin && x <= ringEnd )
+      {
+        ringSum += imgSig[i];
+        ++ringCount;
+      }
+    }
+    if( centerCount > 0 && ringCount > 0
+        && centerSum / centerCount > ringSum / ringCount + kMinPolarity * contrast )
+    {
+      ++polarityAgree;
+    }
+
+    if( !locateEdges )
+      continue;
+
+    // Edges between the center and the outer ring, where the outer edge of the marker
+    // is not reached.
+    const float threshold = ( *minMax.first + *minMax.second ) / 2.f;
+    const float hysteresis = kEdgeHysteresis * contrast;
+    std::vector<float> edges;
+    bool white = imgSig.front() > threshold;
+    for( std::size_t i = 1 ; i < nSamples && i * stepX < 1.f - minGap / 2.f ; ++i )
+    {
+      if( ( white && imgSig[i] < threshold - hysteresis ) || ( !white && imgSig[i] > threshold + hysteresis ) )
+      {
+        white = !white;
+        edges.push_back( ( i - 0.5f ) * stepX );
+      }
+    }
+    edgeCounts.push_back( float( edges.size() ) );
+    if( edges.size() == nEdges )
+      vEdges.push_back( std::move( edges ) );
+  }
+
+  // Most of the marker must be visible to decide.
+  if( contrasts.size() * 2 < kPlausibilityCuts )
+    return true;
+
+  // i) Contrast.
+  if( computeMedian( contrasts ) < kMinCutContrast )
+    return false;
+
+  // ii) Polarity: white center, black outer ring.
+  if( polarityAgree * 2 < contrasts.size() )
+    return false;
+
+  if( !locateEdges )
+    return true;
+
+  // iii) Number of ring edges.
+  if( std::abs( computeMedian( edgeCounts ) - float( nEdges ) ) > kMaxEdgeCountError )
+    return false;
+
+  // iv) Rough barcode: the edges must be near the radii of a marker of the bank.
+  if( vEdges.size() >= 3 )
+  {
+    std::vector<float> distances;
+    distances.reserve( vEdges.size() );
+    for( const std::vector<float> & edges : vEdges )
+    {
+      float distance = std::numeric_limits<float>::max();
+      for( const std::vector<float> & radiusRatios : rrBank )
+      {
+        if( radiusRatios.size() != nEdges )
+          continue;
+        float maxError = 0.f;
+        for( std::size_t iEdge = 0 ; iEdge < nEdges ; ++iEdge )
+          maxError = std::max( maxError, std::abs( edges[iEdge] - 1.f / radiusRatios[iEdge] ) );
+        distance = std::min( distance, maxError );
+      }
+      distances.push_back( distance );
+    }
+    if( computeMedian( distances ) > kMaxBarcodeError )
+      return false;
+  }
+
+  return true;
+}
+
 /**
  * @brief Identify a marker:
  *   i) its imaged center is optimized: A. 1D image cuts are selected ; B. the optimization is performed 
@@ -1161,6 +1482,8 @@ float costFunctionGlob(
  *        approach where the distance to the cctag bank's profiles used is the one described in [Orazio et al. 2011]
  * @param[in] tagIndex a sequence number assigned to this tag
  * @param[in] cctag whose center is to be optimized in conjunction with its associated homography.
+ * @param[in] radiusRatios bank of radius ratios, for the rejection of implausible signals
+ * (Parameters::_rejectImplausible).
  * @param[in] src original gray scale image (original scale, uchar)
  * @param[in] params set of parameters
  * @return status of the markers (c.f. all the possible status are located in CCTag.hpp) 
@@ -1169,6 +1492,7 @@ int identify_step_1(
   int tagIndex,
   const CCTag & cctag,
   std::vector<cctag::ImageCut>& vSelectedCuts,
+  const std::vector< std::vector<float> > & radiusRatios,
   const cv::Mat &  src,
   const cctag::Parameters & params)
 {
@@ -1201,6 +1525,13 @@ int identify_step_1(
   
   if(outerPoints.size() < 5)
       return status::too_few_outer_points;
+
+  // Cheap rejection of the clear non-markers before the expensive stages.
+  if( params._rejectImplausible && !plausibleSignal( ellipse, outerPoints, radiusRatios, src, params ) )
+  {
+    DO_TALK( CCTAG_COUT_DEBUG( "Implausible signal, rejected before identification." ); )
+    return status::implausible_signal;
+  }
  
   // todo: next line deprec, associated to SUBPIX_EDGE_OPTIM, do not remove.
   const float cutLengthOuterPointRefine = std::min( ellipse.a(), ellipse.b() ) * 0.12;
@@ -1208,39 +1539,33 @@ int identify_step_1(
   // Visual debug
   for(const cctag::DirectedPoint2d<Eigen::Vector3f> & point : outerPoints)
   {
-    CCTagVisualDebug::instance().drawPoint( Point2d<Eigen::Vector3f>(point.x(), point.y()), cctag::color_green );
+    CCTAG_VISUAL_DEBUG_HOOK(drawPoint( Point2d<Eigen::Vector3f>(point.x(), point.y()), cctag::color_green ));
   }
 
-  // Set from where the rectified 1D signal should be read.
-  // In fact, the white area located inside the inner ellipse does not hold
-  // any information neither for the optimization nor for the reading.
-  float startSig = 0.f;
-  if (params._nCrowns == 3)
-  {
-    // Signal begin at 25% of the unit radius (for 3 black rings markers).
-    // startOffset
-    startSig = 1 - (2*params._nCrowns-1)*0.15;
-  }
-  else if (params._nCrowns == 4)
-  {
-    startSig = 0.26; // todo@Lilian
-  }
-  else
-  {
-    CCTAG_COUT("Error : unknown number of crowns");
-  }
-  // The "signal of interest" is located between startSig and 1.f (endSig in ImageCut)
+  const float startSig = signalBegin( params );
 
 #ifdef CCTAG_OPTIM
   t0 = boost::posix_time::microsec_clock::local_time();
 #endif
   
-  // B. Collect all cuts associated to all outer points ////////////////////////
-  std::vector<cctag::ImageCut> cuts;
+  // B. Select a sub sample of the cuts associated to all outer points /////////
+  // Only the selected cuts are collected.
+  std::size_t nCollectedCuts = 0;
   {
     boost::posix_time::ptime tstart( boost::posix_time::microsec_clock::local_time() );
+
+    nCollectedCuts = selectCutLazyUniform(
+            vSelectedCuts,
+            params._numCutsInIdentStep,
+            ellipse,
+            outerPoints,
+            src,
+            params._sampleCutLength,
+            startSig,
+            cctag.scale(),
+            params._numSamplesOuterEdgePointsRefinement);
     
-    collectCuts( cuts, src, ellipse.center(), outerPoints, params._sampleCutLength, startSig);
+    DO_TALK( CCTAG_COUT_OPTIM("Initial cut selection"); )
     
     boost::posix_time::ptime tend( boost::posix_time::microsec_clock::local_time() );
     boost::posix_time::time_duration d = tend - tstart;
@@ -1253,35 +1578,15 @@ int identify_step_1(
   DO_TALK(
 
     spendTime = d.total_milliseconds();
-    CCTAG_COUT_OPTIM("Time in collectCuts: " << spendTime << " ms");
+    CCTAG_COUT_OPTIM("Time in cut selection: " << spendTime << " ms");
   )
 #endif
 
-  if ( cuts.size() == 0 )
+  if ( nCollectedCuts == 0 )
   {
     // Can happen when an object or the image frame is occluding a part of all available cuts.
     return status::no_collected_cuts;
   }
-  
-  // C. Select a sub sample of image cuts //////////////////////////////////////
-  {
-    boost::posix_time::ptime tstart( boost::posix_time::microsec_clock::local_time() );
-
-    selectCutCheapUniform(
-            vSelectedCuts,
-            params._numCutsInIdentStep,
-            ellipse,
-            cuts,
-            src,
-            cctag.scale(),
-            params._numSamplesOuterEdgePointsRefinement);
-    
-    DO_TALK( CCTAG_COUT_OPTIM("Initial cut selection"); )
-    
-    boost::posix_time::ptime tend( boost::posix_time::microsec_clock::local_time() );
-    boost::posix_time::time_duration d = tend - tstart;
-    const float spendTime = d.total_milliseconds();
-  }
 
   if ( vSelectedCuts.size() == 0 )
   {
@@ -1324,6 +1629,7 @@ int identify_step_2(
   const cctag::numerical::geometry::Ellipse & ellipse = cctag.rescaledOuterEllipse();
 
   float residual = std::numeric_limits<float>::max();
+  std::vector<float> barCode;
     
   // C. Imaged center optimization /////////////////////////////////////////////
   // Expensive (GPU) Time bottleneck, the only function (including its sub functions) to be implemented on GPU
@@ -1347,7 +1653,9 @@ int identify_step_2(
 #else
                         nullptr,
 #endif
-                        residual
+                        residual,
+                        cctag.centerSearchSize(),
+                        &barCode
                         );
   
   cctag.setQuality(1.f/residual);
@@ -1377,11 +1685,21 @@ int identify_step_2(
   {
     boost::posix_time::ptime tstart( boost::posix_time::microsec_clock::local_time() );
 
+  // D. Read the rectified 1D signals and retrieve the nearest ID(s) ///////////
+  int iMax = 0;
+  float score = 0;
+  if ( params._barCodeIdentification && !barCode.empty() )
+  {
+    barCodeIdentification( iMax, score, idSet, radiusRatios, barCode, vSelectedCuts, params._minIdentProba, sizeIds );
+  }
+  else
+  {
     std::vector<std::list<float> > vScore;
     vScore.resize(radiusRatios.size());
 
-  // D. Read the rectified 1D signals and retrieve the nearest ID(s) ///////////
-  identSuccessful = orazioDistanceRobust( vScore, radiusRatios, vSelectedCuts, params._minIdentProba);
+    identSuccessful = orazioDistanceRobust( vScore, radiusRatios, vSelectedCuts, params._minIdentProba);
+    mostVotedId( iMax, score, vScore );
+  }
     
 #ifdef CCTAG_VISUAL_DEBUG // todo: write a proper function in visual debug
   cv::Mat output;
@@ -1401,31 +1719,6 @@ int identify_step_2(
     {
 #endif // GRIFF_DEBUG
 
-      int maxSize = 0;
-      int i = 0;
-      int iMax = 0;
-
-      for(const std::list<float> & lResult : vScore)
-      {
-        if (lResult.size() > maxSize)
-        {
-          iMax = i;
-          maxSize = lResult.size();
-        }
-        ++i;
-      }
-
-      float score = 0;
-#ifdef GRIFF_DEBUG
-      assert( vScore.size() > 0 );
-      assert( vScore.size() > iMax );
-#endif // GRIFF_DEBUG
-      for(const float & proba : vScore[iMax])
-      {
-        score += proba;
-      }
-      score /= vScore[iMax].size();
-
       // Set CCTag id
       cctag.setId( iMax );
       cctag.setIdSet( idSet );
@@ -1434,18 +1727,7 @@ int identify_step_2(
       // Push all the ellipses based on the obtained homography.
       try
       {
-
-        Eigen::Matrix3f mInvH = cctag.homography().inverse();
-        std::vector<cctag::numerical::geometry::Ellipse> & ellipses = cctag.ellipses();
-
-        for(const float radiusRatio : cctag.radiusRatios())
-        {
-          cctag::numerical::geometry::Circle circle(1.f / radiusRatio);
-          ellipses.emplace_back(mInvH.transpose()*circle.matrix()*mInvH);
-        }
-
-        // Push the outer ellipse
-        ellipses.push_back(cctag.rescaledOuterEllipse());
+        pushImagedCircles( cctag );
 
         DO_TALK( CCTAG_COUT_VAR_DEBUG(cctag.id()); )
       }
@@ -1475,5 +1757,81 @@ int identify_step_2(
   }
 }
 
+void pushImagedCircles( CCTag & cctag )
+{
+  Eigen::Matrix3f mInvH = cctag.homography().inverse();
+  std::vector<cctag::numerical::geometry::Ellipse> & ellipses = cctag.ellipses();
+
+  for(const float radiusRatio : cctag.radiusRatios())
+  {
+    cctag::numerical::geometry::Circle circle(1.f / radiusRatio);
+    ellipses.emplace_back(mInvH.transpose()*circle.matrix()*mInvH);
+  }
+
+  // Push the outer ellipse
+  ellipses.push_back(cctag.rescaledOuterEllipse());
+}
+
+float profileAgreement(
+  const cctag::numerical::geometry::Ellipse & ellipse,
+  const std::vector< cctag::DirectedPoint2d<Eigen::Vector3f> > & outerEllipsePoints,
+  const std::vector<float> & radiusRatios,
+  const Eigen::Matrix3f & mHomography,
+  const cv::Mat & src,
+  const cctag::Parameters & params,
+  std::size_t numCuts)
+{
+  std::vector< cctag::DirectedPoint2d<Eigen::Vector3f> > outerPoints;
+  getSortedOuterPoints(ellipse, outerEllipsePoints, outerPoints, numCuts);
+  if( outerPoints.size() < 3 )
+    return 0.f;
+
+  const float startSig = signalBegin( params );
+  std::vector<cctag::ImageCut> cuts;
+  cuts.reserve( outerPoints.size() );
+  for( const cctag::DirectedPoint2d<Eigen::Vector3f> & outerPoint : outerPoints )
+  {
+    cuts.emplace_back( ellipse.center(), outerPoint, startSig, 1.f, params._sampleCutLength );
+  }
+  getSignals( cuts, mHomography, src );
+
+  std::vector<float> agreements;
+  agreements.reserve( cuts.size() );
+  for( const cctag::ImageCut & cut : cuts )
+  {
+    if( cut.outOfBounds() )
+      continue;
+
+    const std::vector<float> & imgSig = cut.imgSignal();
+    const auto minMax = std::minmax_element( imgSig.begin(), imgSig.end() );
+    const float threshold = ( *minMax.first + *minMax.second ) / 2.f;
+    const float stepX = ( cut.endSig() - cut.beginSig() ) / ( imgSig.size() - 1.f );
+
+    std::size_t agree = 0;
+    float x = cut.beginSig();
+    for( const float value : imgSig )
+    {
+      // An even number of circles inside the radius x is a white sample, as
+      // for the profiles of orazioDistanceRobust.
+      std::size_t inside = 0;
+      for( const float radiusRatio : radiusRatios )
+      {
+        if( 1.f / radiusRatio <= x )
+          ++inside;
+      }
+      if( ( inside % 2 == 0 ) == ( value > threshold ) )
+        ++agree;
+      x += stepX;
+    }
+    agreements.push_back( float( agree ) / imgSig.size() );
+  }
+
+  // Most of the marker must be visible.
+  if( agreements.size() * 2 < cuts.size() )
+    return 0.f;
+
+  return computeMedian( agreements );
+}
+
 } // namespace identification
 } // namespace cctag
@@ -59,7 +59,7 @@ int identify_step_1(
     int tagIndex,
 	const CCTag & cctag,
     std::vector<cctag::ImageCut>& vSelectedCuts,
-	// const std::vector< std::vector<float> > & radiusRatios,
+	const std::vector< std::vector<float> > & radiusRatios,
 	const cv::Mat & src,
     // cctag::TagPipe* pipe,
 	const cctag::Parameters & params);
@@ -128,6 +128,32 @@ bool orazioDistanceRobust(
         const std::vector<cctag::ImageCut> & cuts,
         float minIdentProba);
 
+/**
+ * @brief Identify a marker from its barcode, the median of its rectified 1D signals
+ * (c.f. refineConicFamilyGlob): the whole bank is scored once, against the barcode, and
+ * the cuts only vote, as in orazioDistanceRobust, between the ids about as near to it
+ * as the nearest one.
+ *
+ * @param[out] id identified id
+ * @param[out] score probability of id given the barcode (not the mean probability of the
+ * votes of the cuts, as with orazioDistanceRobust)
+ * @param[out] idSet sizeIds nearest ids to the barcode, along with their probability
+ * @param[in] rrBank Set of vector of radius ratio describing the 1D profile of the cctag library
+ * @param[in] barCode median of the rectified signals of cuts
+ * @param[in] cuts image cuts holding the rectified 1D signal
+ * @param[in] minIdentProba minimal probability to considered a cctag as correctly identified
+ * @param[in] sizeIds number of ids in idSet
+ */
+void barCodeIdentification(
+        MarkerID & id,
+        float & score,
+        IdSet & idSet,
+        const RadiusRatioBank & rrBank,
+        const std::vector<float> & barCode,
+        const std::vector<cctag::ImageCut> & cuts,
+        float minIdentProba,
+        std::size_t sizeIds);
+
 /**
  * @brief Extract a rectified 1D signal along an image cut based on an homography.
  * 
@@ -168,24 +194,6 @@ void blurImageCut(float sigma, cctag::ImageCut & cut);
 
 bool outerEdgeRefinement(ImageCut & cut, const cv::Mat & src, float scale, size_t numSamplesOuterEdgePointsRefinement);
 
-/**
- * @brief Collect signals (image cuts) from center to outer ellipse points
- * 
- * @param[out] cuts collected cuts
- * @param[in] src source gray scale image (uchar)
- * @param[in] center outer ellipse center
- * @param[in] outerPoints outer ellipse points
- * @param[in] nSamplesInCut number of samples collected in an image cut
- * @param[in] beginSig offset from which the signal must be collected (in [0 1])
- */
-void collectCuts(
-        std::vector<cctag::ImageCut> & cuts, 
-        const cv::Mat & src,
-        const cctag::Point2d<Eigen::Vector3f> & center,
-        const std::vector< cctag::DirectedPoint2d<Eigen::Vector3f> > & outerPoints,
-        std::size_t sampleCutLength,
-        std::size_t startOffset );
-
 /*
  * @brief Bilinear interpolation for a point whose coordinates are (x,y)
  * 
@@ -245,6 +253,9 @@ void getSignals(
  * @param[in] src source image
  * @param[in] outerEllipse outer ellipse
  * @param[in] params parameters of the cctag algorithm
+ * @param[in] initialNeighbourSize size of the first search neighbourhood around optimalPoint,
+ * relatively to the outer ellipse; 0 for params._imagedCenterNeighbourSize
+ * @param[out] medianBarCode if not null, median over vCuts of their rectified signals
  * @return true if the optimization has found a solution, false otherwise.
  */
 bool refineConicFamilyGlob(
@@ -257,7 +268,9 @@ bool refineConicFamilyGlob(
         const cctag::numerical::geometry::Ellipse & outerEllipse,
         const cctag::Parameters & params,
         cctag::NearbyPoint* cctag_pointer_buffer,
-        float & residual);
+        float & residual,
+        float initialNeighbourSize = 0.f,
+        std::vector<float> * medianBarCode = nullptr);
 
 /**
  * @brief Convex optimization of the imaged center within a point's neighbourhood.
@@ -382,6 +395,60 @@ inline float dis( const float sig, const float val, const float mub, const float
   }
 }
 
+/**
+ * @brief Push into cctag.ellipses() the images of the circles of the marker, given by
+ * its homography and radius ratios, then its outer ellipse.
+ * An exception is thrown if a degenerate ellipse is computed.
+ */
+void pushImagedCircles( CCTag & cctag );
+
+/**
+ * @brief Cascade of cheap tests rejecting the candidates that clearly are not markers
+ * before the cut selection and the optimization of their imaged center. A few cuts are
+ * read from the center of the outer ellipse, i.e. assuming an affine transformation, and
+ * their signal must have some contrast, a white center inside a black outer ring, about
+ * as many ring edges as the markers of the bank and, when the rings are wide enough to
+ * be located, edges near the radii of one of them.
+ *
+ * @param[in] ellipse outer ellipse, in src
+ * @param[in] outerPoints points of the outer ellipse sorted by angle, in src
+ * @param[in] rrBank radius ratios of the bank
+ * @param[in] src gray scale image (uchar)
+ * @param[in] params set of parameters
+ * @return false if the candidate is not a marker; true if it may be one, or if too few
+ * cuts are in the image to decide.
+ */
+bool plausibleSignal(
+  const cctag::numerical::geometry::Ellipse & ellipse,
+  const std::vector< cctag::DirectedPoint2d<Eigen::Vector3f> > & outerPoints,
+  const RadiusRatioBank & rrBank,
+  const cv::Mat & src,
+  const cctag::Parameters & params);
+
+/**
+ * @brief Cheap reading of a marker whose id is already known, e.g. from the previous
+ * frame of a video: a few cuts are rectified with the given homography, without any
+ * optimization of the imaged center, and compared to the profile of that id only.
+ *
+ * @param[in] ellipse outer ellipse, in src
+ * @param[in] outerEllipsePoints points of the outer ellipse, in src
+ * @param[in] radiusRatios radius ratios of the expected id
+ * @param[in] mHomography cctag->image homography
+ * @param[in] src gray scale image (uchar)
+ * @param[in] params set of parameters
+ * @param[in] numCuts number of cuts to read
+ * @return median over the cuts of the fraction of samples on the expected side of the
+ * ring edges, in [0,1]; 0 if less than half of the cuts are in the image.
+ */
+float profileAgreement(
+  const cctag::numerical::geometry::Ellipse & ellipse,
+  const std::vector< cctag::DirectedPoint2d<Eigen::Vector3f> > & outerEllipsePoints,
+  const std::vector<float> & radiusRatios,
+  const Eigen::Matrix3f & mHomography,
+  const cv::Mat & src,
+  const cctag::Parameters & params,
+  std::size_t numCuts);
+
 /* depreciated */
 bool refineConicFamily(
         CCTag & cctag,
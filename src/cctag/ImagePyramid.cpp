@@ -7,6 +7,7 @@
  */
 #include <cctag/utils/Defines.hpp>
 #include <cctag/ImagePyramid.hpp>
+#include <cctag/Params.hpp>
 #include <cctag/utils/VisualDebug.hpp>
 
 #include <opencv2/imgproc/imgproc.hpp>
@@ -44,11 +45,21 @@ void ImagePyramid::build( const cv::Mat & src, float thrLowCanny, float thrHighC
 
     /* The pyramid building function is never called if CUDA is used.
      */
-  _levels[0]->setLevel( src , thrLowCanny, thrHighCanny, params );
-  
-  for(int i = 1; i < _levels.size() ; ++i)
+  // Levels finer than the processed ones only need their image, for the next
+  // level and the identification; coarser ones are not built at all. In
+  // coarse-to-fine mode, the edges of the levels finer than the full frame
+  // ones are extracted during the detection, around the candidates.
+  std::size_t firstLevel, lastLevel;
+  params->processedLevels( firstLevel, lastLevel );
+  const std::size_t fullFrameLevel = params->fullFrameLevel();
+
+  for(std::size_t i = 0; i < _levels.size() && i <= lastLevel ; ++i)
   {
-    _levels[i]->setLevel( _levels[i-1]->getSrc(), thrLowCanny, thrHighCanny, params );
+    const cv::Mat & levelSrc = ( i == 0 ) ? src : _levels[i-1]->getSrc();
+    if( i < fullFrameLevel )
+      _levels[i]->setSrc( levelSrc );
+    else
+      _levels[i]->setLevel( levelSrc, thrLowCanny, thrHighCanny, params );
   }
   
 #ifdef CCTAG_SERIALIZE
@@ -34,6 +34,7 @@ public:
   std::size_t getNbLevels() const;
   
     /* The pyramid building function is never called if CUDA is used.
+     * Only the levels given by Parameters::processedLevels get their edges.
      */
   void build(const cv::Mat & src, float thrLowCanny, float thrHighCanny, const cctag::Parameters* params );
 
@@ -63,7 +63,7 @@ void Level::setLevel( const cv::Mat & src,
         exit( -__LINE__ );
     }
 
-    cv::resize( src, *_src, cv::Size(_src->cols,_src->rows) );
+    setSrc( src );
     // ASSERT TODO : check that the data are allocated here
     // Compute derivative and canny edge extraction.
     cvRecodedCanny( *_src, *_edges, *_dx, *_dy,
@@ -79,6 +79,44 @@ void Level::setLevel( const cv::Mat & src,
     thin(*_edges,_temp);
 }
 
+void Level::setSrc( const cv::Mat & src )
+{
+    if( src.type() == CV_8UC2 && src.size() == _src->size() ) {
+        // YUYV input at full resolution: the luma is the first byte of each pixel,
+        // extract it in the pass that fills this level.
+        cv::extractChannel( src, *_src, 0 );
+    } else {
+        cv::resize( src, *_src, cv::Size(_src->cols,_src->rows) );
+    }
+}
+
+void Level::setEdges( const std::vector<cv::Rect> & regions,
+                      float thrLowCanny,
+                      float thrHighCanny,
+                      const cctag::Parameters* params )
+{
+    if( _cuda_allocates ) {
+        std::cerr << "This function makes no sense with CUDA in " << __FUNCTION__ << ":" << __LINE__ << std::endl;
+        exit( -__LINE__ );
+    }
+
+    _edges->setTo( 0 );
+    for( const cv::Rect & region : regions ) {
+        cv::Mat edges = (*_edges)( region );
+        cv::Mat dx    = (*_dx)( region );
+        cv::Mat dy    = (*_dy)( region );
+        cvRecodedCanny( (*_src)( region ), edges, dx, dy,
+                        thrLowCanny * 256, thrHighCanny * 256,
+                        3 | CV_CANNY_L2_GRADIENT,
+                        _level, params );
+        // The thinning does not write the border of its temporary image,
+        // which may hold the edges of another region here.
+        cv::Mat temp = _temp( region );
+        temp.setTo( 0 );
+        thin( edges, temp );
+    }
+}
+
 #ifdef CCTAG_WITH_CUDA
 void Level::setLevel( cctag::TagPipe*         cuda_pipe,
                       const cctag::Parameters& params )
@@ -128,4 +166,20 @@ const cv::Mat & Level::getEdges() const
     return *_edges;
 }
 
+void mergeOverlappingRegions( std::vector<cv::Rect> & regions )
+{
+    for( bool merged = true; merged; ) {
+        merged = false;
+        for( std::size_t i = 0; i < regions.size() && !merged; ++i ) {
+            for( std::size_t j = i+1; j < regions.size() && !merged; ++j ) {
+                if( ( regions[i] & regions[j] ).area() > 0 ) {
+                    regions[i] |= regions[j];
+                    regions.erase( regions.begin() + j );
+                    merged = true;
+                }
+            }
+        }
+    }
+}
+
 }
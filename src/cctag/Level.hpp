@@ -10,6 +10,8 @@
 
 #include <opencv2/opencv.hpp>
 
+#include <vector>
+
 namespace cctag {
     class TagPipe;
 };
@@ -30,6 +32,19 @@ public:
                  float thrLowCanny,
                  float thrHighCanny,
                  const cctag::Parameters* params );
+
+  /* Only fill the image of the level, without the derivatives and edges, for
+   * a level that is not processed but whose image is still needed.
+   */
+  void setSrc( const cv::Mat & src );
+
+  /* Extract the derivatives and edges of the image set by setSrc only in
+   * regions, which must not overlap; the edges are empty elsewhere.
+   */
+  void setEdges( const std::vector<cv::Rect> & regions,
+                 float thrLowCanny,
+                 float thrHighCanny,
+                 const cctag::Parameters* params );
 #ifdef CCTAG_WITH_CUDA
   void setLevel( cctag::TagPipe* cuda_pipe,
                  const cctag::Parameters& params );
@@ -75,6 +90,11 @@ private:
 #endif
 };
 
+/* Replace overlapping regions by their bounding rectangle until none
+ * overlap, so that no pixel is processed twice.
+ */
+void mergeOverlappingRegions( std::vector<cv::Rect> & regions );
+
 }
 
 #endif	/* _CCTAG_LEVEL_HPP */
@@ -13,6 +13,7 @@
 #include <cctag/geometry/EllipseFromPoints.hpp>
 #include <cctag/Fitting.hpp>
 #include <cctag/Canny.hpp>
+#include <cctag/StageRecord.hpp>
 #include <cctag/Detection.hpp>
 #include <cctag/utils/Talk.hpp> // for DO_TALK macro
 
@@ -192,16 +193,60 @@ void update(
   }
 }
 
+// Margin of the regions around the candidates of the coarser level, relative
+// to their radius, and border for the derivative filters and the thinning.
+static const float kCandidateRegionMargin = 0.25f;
+static const int   kCandidateRegionBorder = 8;
+
+// Regions of a level around the candidates of the next coarser level.
+static std::vector<cv::Rect> candidateRegions(
+        const CCTag::List&      candidates,
+        const Level*            level )
+{
+  const cv::Rect image( 0, 0, level->width(), level->height() );
+  std::vector<cv::Rect> regions;
+  for(const CCTag & candidate : candidates)
+  {
+    const numerical::geometry::Ellipse & ellipse = candidate.outerEllipse();
+    const int radius = int( std::ceil( 2.f * std::max( ellipse.a(), ellipse.b() ) * ( 1.f + kCandidateRegionMargin ) ) )
+                     + kCandidateRegionBorder;
+    const cv::Rect region = cv::Rect( int( 2.f * ellipse.center().x() ) - radius,
+                                      int( 2.f * ellipse.center().y() ) - radius,
+                                      2 * radius, 2 * radius ) & image;
+    if( region.area() > 0 )
+      regions.push_back( region );
+  }
+  mergeOverlappingRegions( regions );
+  return regions;
+}
+
+// No edges were extracted on the original image: the outer ellipse of a marker
+// is the one of its level, its center and points are rescaled.
+static void rescaleToFullResolution( CCTag & marker )
+{
+  std::vector< DirectedPoint2d<Eigen::Vector3f> > rescaledOuterEllipsePoints = marker.points().back();
+  for(DirectedPoint2d<Eigen::Vector3f> & p : rescaledOuterEllipsePoints)
+  {
+    p.x() *= marker.scale();
+    p.y() *= marker.scale();
+  }
+  marker.setCenterImg(cctag::Point2d<Eigen::Vector3f>(marker.centerImg().x() * marker.scale(),
+                                                      marker.centerImg().y() * marker.scale()));
+  marker.setRescaledOuterEllipsePoints(rescaledOuterEllipsePoints);
+}
+
 static void cctagMultiresDetection_inner(
         size_t                  i,
         CCTag::List&            pyramidMarkers,
         const cv::Mat&          imgGraySrc,
         Level*                  level,
+        const std::vector<cv::Rect>& regions,
         const std::size_t       frame,
         EdgePointCollection&    edgeCollection,
         cctag::TagPipe*        cuda_pipe,
         const Parameters &      params,
-        cctag::logtime::Mgmt*   durations )
+        cctag::logtime::Mgmt*   durations,
+        Deadline*               deadline )
 {
     DO_TALK( CCTAG_COUT_OPTIM(":::::::: Multiresolution level " << i << "::::::::"); )
 
@@ -222,25 +267,48 @@ static void cctagMultiresDetection_inner(
       CCTagVisualDebug::instance().setPyramidLevel(i);
     } else { // not cuda_pipe
 #endif // defined(CCTAG_WITH_CUDA)
-    edgesPointsFromCanny( edgeCollection,
-                          level->getEdges(),
-                          level->getDx(),
-                          level->getDy());
+    if( regions.empty() ) {
+        edgesPointsFromCanny( edgeCollection,
+                              level->getEdges(),
+                              level->getDx(),
+                              level->getDy());
+    } else {
+        for( const cv::Rect & region : regions ) {
+            edgesPointsFromCanny( edgeCollection,
+                                  level->getEdges(),
+                                  level->getDx(),
+                                  level->getDy(),
+                                  region );
+        }
+    }
+
+    if( durations ) durations->log( "after edgesPointsFromCanny", i );
 
     CCTagVisualDebug::instance().setPyramidLevel(i);
 
-    // Voting procedure applied on every edge points.
+    // Voting procedure applied on every edge points, searching as far as the
+    // rings of the largest markers expected on this level.
+    Parameters levelParams( params );
+    levelParams._distSearch = params.distSearchAtLevel( i );
     vote( edgeCollection,
           seeds,        // output
           level->getDx(),
           level->getDy(),
-          params );
+          levelParams );
     
     if( seeds.size() > 1 ) {
         // Sort the seeds based on the number of received votes.
         std::sort(seeds.begin(), seeds.end(), receivedMoreVoteThan);
     }
 
+    if( durations ) durations->log( "after vote", i );
+
+    if( !params._recordDir.empty() ) {
+        std::stringstream recordName;
+        recordName << params._recordDir << "/frame" << frame << "_level" << i << ".edges";
+        EdgeRecord::write( recordName.str(), edgeCollection, seeds, frame, i );
+    }
+
 #if defined(CCTAG_WITH_CUDA)
     } // not cuda_pipe
 #endif // defined(CCTAG_WITH_CUDA)
@@ -252,7 +320,7 @@ static void cctagMultiresDetection_inner(
         level->getSrc(),
         seeds,
         frame, i, std::pow(2.0, (int) i), params,
-        durations );
+        durations, deadline );
 
     CCTagVisualDebug::instance().initBackgroundImage(level->getSrc());
     std::stringstream outFilename2;
@@ -272,7 +340,9 @@ void cctagMultiresDetection(
         std::size_t   frame,
         cctag::TagPipe*    cuda_pipe,
         const Parameters&   params,
-        cctag::logtime::Mgmt* durations )
+        cctag::logtime::Mgmt* durations,
+        DetectionObserver* observer,
+        Deadline* deadline )
 {
   //	* For each pyramid level:
   //	** launch CCTag detection based on the canny edge detection output.
@@ -280,28 +350,66 @@ void cctagMultiresDetection(
   std::map<std::size_t, CCTag::List> pyramidMarkers;
   std::list<EdgePointCollection> vEdgePointCollections;
 
+  // Only the levels where the expected markers can be are processed.
+  std::size_t firstLevel, lastLevel;
+  params.processedLevels( firstLevel, lastLevel );
+
   BOOST_ASSERT( params._numberOfMultiresLayers - params._numberOfProcessedMultiresLayers >= 0 );
   // for ( std::size_t i = 0 ; i < params._numberOfProcessedMultiresLayers; ++i )
-  for( int i = params._numberOfProcessedMultiresLayers-1; i >= 0; i-- )
+  const std::size_t fullFrameLevel = params.fullFrameLevel();
+  for( int i = lastLevel; i >= int(firstLevel); i-- )
   {
+    // Past the deadline, the finer levels are skipped.
+    if( deadline && deadline->reached() )
+      break;
+
     pyramidMarkers.insert( std::pair<std::size_t, CCTag::List>( i, CCTag::List() ) );
+
+    // Coarse-to-fine: the finer levels are only searched around the
+    // candidates of the previous one.
+    std::vector<cv::Rect> regions;
+    if( !cuda_pipe && i < int(fullFrameLevel) )
+    {
+      regions = candidateRegions( pyramidMarkers[i+1], imagePyramid.getLevel(i) );
+      if( regions.empty() )
+        continue;
+      imagePyramid.getLevel(i)->setEdges( regions, params._cannyThrLow, params._cannyThrHigh, &params );
+      if( durations ) durations->log( "after region edges", i );
+    }
+
     vEdgePointCollections.emplace_back(imgGraySrc.cols, imgGraySrc.rows);
     
     cctagMultiresDetection_inner( i,
                                   pyramidMarkers[i],
                                   imgGraySrc,
                                   imagePyramid.getLevel(i),
+                                  regions,
                                   frame,
                                   vEdgePointCollections.back(),
                                   cuda_pipe,
                                   params,
-                                  durations );
+                                  durations,
+                                  deadline );
+
+    // Without the original image to refine them on, the markers of the level
+    // are localized as soon as they are rescaled: report them before the
+    // finer levels are searched. They are rescaled on a copy as the next
+    // level reads their ellipses in level coordinates.
+    if( observer && firstLevel > 0 )
+    {
+      for(const CCTag & marker : pyramidMarkers[i])
+      {
+        CCTag rescaled(marker);
+        rescaleToFullResolution(rescaled);
+        observer->localized(frame, rescaled);
+      }
+    }
   }
   if( durations ) durations->log( "after cctagMultiresDetection_inner" );
   
   // Gather the detected markers in the entire image pyramid
   BOOST_ASSERT( params._numberOfMultiresLayers - params._numberOfProcessedMultiresLayers >= 0 );
-  for (std::size_t i = 0 ; i < params._numberOfProcessedMultiresLayers ; ++i)
+  for (std::size_t i = firstLevel ; i <= lastLevel ; ++i)
   {
     CCTag::List & markersList = pyramidMarkers[i];
     for(const CCTag & marker : markersList)
@@ -321,7 +429,11 @@ void cctagMultiresDetection(
   {
     int i = marker.pyramidLevel();
     // if the marker has to be rescaled into the original image
-    if (i > 0)
+    if (i > 0 && firstLevel > 0)
+    {
+      rescaleToFullResolution(marker);
+    }
+    else if (i > 0)
     {
       BOOST_ASSERT( i < params._numberOfMultiresLayers );
       float scale = marker.scale(); // pow( 2.0, (float)i );
@@ -381,7 +493,7 @@ void cctagMultiresDetection(
                   e->dY()
           );
           
-          CCTagVisualDebug::instance().drawPoint(Point2d<Eigen::Vector3f>(e->x(), e->y()), cctag::color_red);
+          CCTAG_VISUAL_DEBUG_HOOK(drawPoint(Point2d<Eigen::Vector3f>(e->x(), e->y()), cctag::color_red));
         }
         marker.setCenterImg(cctag::Point2d<Eigen::Vector3f>(marker.centerImg().x() * scale, marker.centerImg().y() * scale));
         marker.setRescaledOuterEllipse(rescaledOuterEllipse);
@@ -398,6 +510,14 @@ void cctagMultiresDetection(
     }
   }
   if( durations ) durations->log( "after marker projection" );
+
+  // The markers of the coarser levels are refined on the edges of the original
+  // image, only extracted at the last level: they are all reported here.
+  if( observer && firstLevel == 0 )
+  {
+    for(const CCTag & marker : markers)
+      observer->localized(frame, marker);
+  }
   
   // Log
   CCTagFileDebug::instance().newSession("data.txt");
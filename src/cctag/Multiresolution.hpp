@@ -28,6 +28,9 @@ struct CCTagParams
 {
 };
 
+class DetectionObserver;
+class Deadline;
+
 /**
  * @brief Detect all CCTag in the image using multiresolution detection.
  * 
@@ -44,7 +47,9 @@ void cctagMultiresDetection(
         std::size_t   frame,
         cctag::TagPipe*    cuda_pipe,
         const Parameters&   params,
-        cctag::logtime::Mgmt* durations );
+        cctag::logtime::Mgmt* durations,
+        DetectionObserver* observer = nullptr,
+        Deadline* deadline = nullptr );
 
 void update(CCTag::List& markers, const CCTag& markerToAdd);
 
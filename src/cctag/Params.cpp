@@ -6,6 +6,7 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 #include "Params.hpp"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
@@ -14,6 +15,22 @@
 namespace cctag
 {
 
+namespace
+{
+
+// Outer diameter, in pixels of a level, below which a marker is not reliably
+// localized on that level.
+const float kMinMarkerDiameterAtLevel = 16.f;
+// Outer diameter, in pixels of a level, above which a marker is left to the
+// next coarser level, where it is localized at a quarter of the cost.
+const float kMaxMarkerDiameterAtLevel = 200.f;
+// Width of the widest ring of the markers relative to their outer diameter,
+// with some margin: kMaxMarkerDiameterAtLevel gives the default _distSearch.
+const float kRingWidthRatio = 0.15f;
+const std::size_t kMinDistSearch = 4;
+
+} // anonymous namespace
+
 bool Parameters::OverrideChecked = false;
 bool Parameters::OverrideLoaded = false;
 Parameters Parameters::Override;
@@ -65,7 +82,13 @@ Parameters::Parameters(std::size_t nCrowns)
     , _doIdentification( kDefaultDoIdentification )
     , _maxEdges( kDefaultMaxEdges )
     , _useCuda( kDefaultUseCuda )
+    , _minMarkerDiameter( kDefaultMinMarkerDiameter )
+    , _maxMarkerDiameter( kDefaultMaxMarkerDiameter )
+    , _coarseToFine( kDefaultCoarseToFine )
+    , _barCodeIdentification( kDefaultBarCodeIdentification )
+    , _rejectImplausible( kDefaultRejectImplausible )
     , _debugDir( "" )
+    , _recordDir( "" )
 {
     _nCircles = 2*_nCrowns;
     
@@ -102,4 +125,61 @@ void Parameters::setUseCuda( bool val )
 #endif // CCTAG_WITH_CUDA
 }
 
+void Parameters::processedLevels( std::size_t & firstLevel, std::size_t & lastLevel ) const
+{
+    firstLevel = 0;
+    lastLevel = _numberOfProcessedMultiresLayers > 0 ? _numberOfProcessedMultiresLayers - 1 : 0;
+
+    // The coarsest level on which the largest markers are still large enough.
+    if( _maxMarkerDiameter > 0 ) {
+        while( lastLevel > 0 &&
+               _maxMarkerDiameter / float( 1 << lastLevel ) < kMinMarkerDiameterAtLevel ) {
+            --lastLevel;
+        }
+    }
+
+    // The finest level on which the smallest markers are not too large.
+    if( _minMarkerDiameter > 0 ) {
+        while( firstLevel < lastLevel &&
+               _minMarkerDiameter / float( 1 << firstLevel ) > kMaxMarkerDiameterAtLevel ) {
+            ++firstLevel;
+        }
+    }
+}
+
+std::size_t Parameters::distSearchAtLevel( std::size_t level ) const
+{
+    if( _maxMarkerDiameter <= 0 )
+        return _distSearch;
+
+    std::size_t firstLevel, lastLevel;
+    processedLevels( firstLevel, lastLevel );
+
+    // The markers too large for this level are left to the coarser ones,
+    // except on the coarsest.
+    float diameter = _maxMarkerDiameter / float( 1 << level );
+    if( level < lastLevel )
+        diameter = std::min( diameter, kMaxMarkerDiameterAtLevel );
+
+    return std::max( std::size_t( std::lround( kRingWidthRatio * diameter ) ), kMinDistSearch );
+}
+
+std::size_t Parameters::fullFrameLevel() const
+{
+    std::size_t firstLevel, lastLevel;
+    processedLevels( firstLevel, lastLevel );
+
+    if( !_coarseToFine )
+        return firstLevel;
+    if( _minMarkerDiameter <= 0 )
+        return lastLevel;
+
+    std::size_t level = lastLevel;
+    while( level > firstLevel &&
+           _minMarkerDiameter / float( 1 << level ) < kMinMarkerDiameterAtLevel ) {
+        --level;
+    }
+    return level;
+}
+
 } // namespace cctag
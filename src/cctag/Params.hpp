@@ -10,6 +10,7 @@
 #include <boost/math/constants/constants.hpp>
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/nvp.hpp>
+#include <boost/serialization/version.hpp>
 
 #include <cmath>
 #include <cstddef>
@@ -58,6 +59,11 @@ static const bool kDefaultSearchForAnotherSegment = true;
 static const bool kDefaultWriteOutput = false;
 static const bool kDefaultDoIdentification = true;
 static const uint32_t kDefaultMaxEdges = 20000;
+static const float kDefaultMinMarkerDiameter = 0.f; // unknown
+static const float kDefaultMaxMarkerDiameter = 0.f; // unknown
+static const bool kDefaultCoarseToFine = false;
+static const bool kDefaultBarCodeIdentification = false;
+static const bool kDefaultRejectImplausible = false;
 #ifdef CCTAG_WITH_CUDA
 static const bool kDefaultUseCuda = true;
 #else
@@ -96,6 +102,11 @@ static const std::string kParamWriteOutput( "kParamWriteOutput" );
 static const std::string kParamDoIdentification( "kParamDoIdentification" );
 static const std::string kParamMaxEdges( "kParamMaxEdges" );
 static const std::string kUseCuda( "kUseCuda" );
+static const std::string kParamMinMarkerDiameter( "kParamMinMarkerDiameter" );
+static const std::string kParamMaxMarkerDiameter( "kParamMaxMarkerDiameter" );
+static const std::string kParamCoarseToFine( "kParamCoarseToFine" );
+static const std::string kParamBarCodeIdentification( "kParamBarCodeIdentification" );
+static const std::string kParamRejectImplausible( "kParamRejectImplausible" );
 
 static const std::size_t kWeight = INV_GRAD_WEIGHT;
 
@@ -152,7 +163,16 @@ struct Parameters
   bool _doIdentification; // perform the identification step
   uint32_t _maxEdges; // max number of edge point, determines memory allocation
   bool        _useCuda; // if compiled CCTAG_WITH_CUDA, allow CLI selection, ignore if not
+  float _minMarkerDiameter; // smallest expected diameter (in pixels of the image) of the outer ellipse, 0 if unknown
+  float _maxMarkerDiameter; // largest expected diameter (in pixels of the image) of the outer ellipse, 0 if unknown
+  bool _coarseToFine; // extract the edges of the levels finer than fullFrameLevel() only around the
+  // candidates of the next coarser level
+  bool _barCodeIdentification; // identify the median signal of the cuts, the cuts only voting between
+  // the ids it cannot tell apart
+  bool _rejectImplausible; // reject the candidates failing the cheap tests of plausibleSignal before
+  // their identification
   std::string _debugDir; // prefix for debug output !!!! ONLY ON COMMAND LINE
+  std::string _recordDir; // if not empty, stage records are written there (see StageRecord.hpp) !!!! ONLY ON COMMAND LINE
 
   template<class Archive>
   void serialize(Archive & ar, const unsigned int version)
@@ -189,12 +209,59 @@ struct Parameters
     ar & BOOST_SERIALIZATION_NVP( _doIdentification );
     ar & BOOST_SERIALIZATION_NVP( _maxEdges );
     ar & BOOST_SERIALIZATION_NVP( _useCuda );
+    if( version >= 1 )
+    {
+      ar & BOOST_SERIALIZATION_NVP( _minMarkerDiameter );
+      ar & BOOST_SERIALIZATION_NVP( _maxMarkerDiameter );
+    }
+    if( version >= 2 )
+    {
+      ar & BOOST_SERIALIZATION_NVP( _coarseToFine );
+    }
+    if( version >= 3 )
+    {
+      ar & BOOST_SERIALIZATION_NVP( _barCodeIdentification );
+    }
+    if( version >= 4 )
+    {
+      ar & BOOST_SERIALIZATION_NVP( _rejectImplausible );
+    }
     _nCircles = 2*_nCrowns;
   }
 
   void setDebugDir( const std::string& debugDir );
 
   void setUseCuda( bool val );
+
+  /**
+   * @brief Range of the pyramid levels worth processing for the expected
+   * marker diameters: those where some expected marker is neither too small
+   * to be localized nor so large that a coarser level handles it better.
+   * All the processed levels if the diameters are unknown.
+   *
+   * @param[out] firstLevel Finest level to process.
+   * @param[out] lastLevel Coarsest level to process, lower than _numberOfProcessedMultiresLayers.
+   */
+  void processedLevels( std::size_t & firstLevel, std::size_t & lastLevel ) const;
+
+  /**
+   * @brief Search distance of the vote on a level: _distSearch, or the width
+   * of the widest ring of the largest expected marker on that level if
+   * _maxMarkerDiameter is set.
+   */
+  std::size_t distSearchAtLevel( std::size_t level ) const;
+
+  /**
+   * @brief Finest level processed on the whole image. In coarse-to-fine mode,
+   * the coarsest level on which the smallest expected markers can still be
+   * localized, or the coarsest processed level if their size is unknown;
+   * the first processed level otherwise.
+   */
+  std::size_t fullFrameLevel() const;
 };
 
 } // namespace cctag
+
+// Version 1 adds _minMarkerDiameter and _maxMarkerDiameter, version 2 _coarseToFine,
+// version 3 _barCodeIdentification, version 4 _rejectImplausible.
+BOOST_CLASS_VERSION( cctag::Parameters, 4 )
@@ -0,0 +1,408 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <cctag/StageRecord.hpp>
+#include <cctag/Detection.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+
+namespace cctag
+{
+
+namespace
+{
+
+const uint32_t kRecordVersion = 1;
+
+struct EdgeRecordHeader
+{
+  char     magic[8];      // "CCTAGEDG"
+  uint32_t version;
+  int32_t  pyramidLevel;
+  uint64_t frame;
+  uint64_t width;
+  uint64_t height;
+  uint64_t pointCount;
+  uint64_t voterCount;
+  uint64_t seedCount;
+};
+
+struct CutRecordHeader
+{
+  char     magic[8];      // "CCTAGCUT"
+  uint32_t version;
+  uint32_t tagCount;
+  uint64_t frame;
+};
+
+// One per edge point; the layout of EdgePoint, which is not trivially copyable.
+struct EdgeRecordPoint
+{
+  int16_t  position[3];
+  int16_t  padding;
+  float    grad[2];
+  float    normGrad;
+  float    flowLength;
+  uint64_t processed;
+  int32_t  isMax;
+  int32_t  nSegmentOut;
+};
+
+// One per tag, followed by its cuts.
+struct CutRecordTag
+{
+  uint32_t tagIndex;
+  uint32_t cutCount;
+};
+
+// One per cut, followed by nSamples floats (padded to 8 bytes).
+struct CutRecordCut
+{
+  float    start[2];
+  float    stop[2];
+  float    stopGrad[2];
+  float    beginSig;
+  float    endSig;
+  uint32_t outOfBounds;
+  uint32_t nSamples;
+};
+
+static_assert(sizeof(EdgeRecordHeader) == 64, "EdgeRecordHeader not packed");
+static_assert(sizeof(EdgeRecordPoint) == 40, "EdgeRecordPoint not packed");
+static_assert(sizeof(CutRecordHeader) == 24, "CutRecordHeader not packed");
+static_assert(sizeof(CutRecordCut) == 40, "CutRecordCut not packed");
+
+std::size_t padded(std::size_t size)
+{
+  return (size + 7) & ~std::size_t(7);
+}
+
+void writePadded(std::ofstream& ofs, const void* data, std::size_t size)
+{
+  static const char zeros[8] = { 0 };
+  ofs.write(static_cast<const char*>(data), size);
+  ofs.write(zeros, padded(size) - size);
+}
+
+const char* mapFile(const std::string& filename, std::size_t& size)
+{
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("StageRecord: unable to open " + filename);
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0 || st.st_size == 0) {
+    ::close(fd);
+    throw std::runtime_error("StageRecord: unable to stat " + filename);
+  }
+  size = st.st_size;
+
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("StageRecord: unable to map " + filename);
+  return static_cast<const char*>(data);
+}
+
+// Returns the section at offset and advances the offset past its padding.
+const char* section(const char* data, std::size_t dataSize, std::size_t& offset, std::size_t size)
+{
+  if (offset + size > dataSize)
+    throw std::runtime_error("StageRecord: truncated record");
+  const char* p = data + offset;
+  offset += padded(size);
+  return p;
+}
+
+} // anonymous namespace
+
+/////////////////////////////////////////////////////////////////////////////
+
+EdgeRecord::EdgeRecord(const std::string& filename)
+  : _data(mapFile(filename, _size))
+{
+  const EdgeRecordHeader* header = reinterpret_cast<const EdgeRecordHeader*>(_data);
+  if (_size < sizeof(EdgeRecordHeader) ||
+      std::memcmp(header->magic, "CCTAGEDG", 8) != 0 ||
+      header->version != kRecordVersion) {
+    ::munmap(const_cast<char*>(_data), _size);
+    throw std::runtime_error("EdgeRecord: invalid record " + filename);
+  }
+}
+
+EdgeRecord::~EdgeRecord()
+{
+  ::munmap(const_cast<char*>(_data), _size);
+}
+
+std::size_t EdgeRecord::frame() const
+{
+  return reinterpret_cast<const EdgeRecordHeader*>(_data)->frame;
+}
+
+int EdgeRecord::pyramidLevel() const
+{
+  return reinterpret_cast<const EdgeRecordHeader*>(_data)->pyramidLevel;
+}
+
+std::size_t EdgeRecord::width() const
+{
+  return reinterpret_cast<const EdgeRecordHeader*>(_data)->width;
+}
+
+std::size_t EdgeRecord::height() const
+{
+  return reinterpret_cast<const EdgeRecordHeader*>(_data)->height;
+}
+
+void EdgeRecord::write(
+        const std::string& filename,
+        const EdgePointCollection& edgeCollection,
+        const std::vector<EdgePoint*>& seeds,
+        std::size_t frame,
+        int pyramidLevel)
+{
+  const std::size_t pointCount = edgeCollection.point_count();
+
+  EdgeRecordHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, "CCTAGEDG", 8);
+  header.version = kRecordVersion;
+  header.pyramidLevel = pyramidLevel;
+  header.frame = frame;
+  header.width = edgeCollection.shape()[0];
+  header.height = edgeCollection.shape()[1];
+  header.pointCount = pointCount;
+  header.voterCount = edgeCollection._votersIndex[pointCount+EdgePointCollection::CUDA_OFFSET];
+  header.seedCount = seeds.size();
+
+  std::vector<EdgeRecordPoint> points(pointCount);
+  for (std::size_t i = 0; i < pointCount; ++i) {
+    const EdgePoint& p = edgeCollection._edgeList[i];
+    EdgeRecordPoint& r = points[i];
+    r.position[0] = p.x();
+    r.position[1] = p.y();
+    r.position[2] = p(2);
+    r.padding = 0;
+    r.grad[0] = p.dX();
+    r.grad[1] = p.dY();
+    r.normGrad = p.normGradient();
+    r.flowLength = p._flowLength;
+    r.processed = p._processed;
+    r.isMax = p._isMax;
+    r.nSegmentOut = p._nSegmentOut;
+  }
+
+  std::vector<int> seedIndices;
+  seedIndices.reserve(seeds.size());
+  for (const EdgePoint* seed : seeds)
+    seedIndices.push_back(edgeCollection(seed));
+
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs)
+    throw std::runtime_error("EdgeRecord: unable to create " + filename);
+
+  writePadded(ofs, &header, sizeof(header));
+  writePadded(ofs, points.data(), pointCount*sizeof(EdgeRecordPoint));
+  writePadded(ofs, &edgeCollection._linkList[0], 2*pointCount*sizeof(int));
+  writePadded(ofs, &edgeCollection._votersIndex[EdgePointCollection::CUDA_OFFSET], (pointCount+1)*sizeof(int));
+  writePadded(ofs, &edgeCollection._votersList[0], header.voterCount*sizeof(int));
+  writePadded(ofs, seedIndices.data(), seedIndices.size()*sizeof(int));
+}
+
+void EdgeRecord::restore(EdgePointCollection& edgeCollection, std::vector<EdgePoint*>& seeds) const
+{
+  const EdgeRecordHeader& header = *reinterpret_cast<const EdgeRecordHeader*>(_data);
+  if (edgeCollection.shape()[0] != header.width || edgeCollection.shape()[1] != header.height)
+    throw std::length_error("EdgeRecord::restore: inconsistent image size");
+  if (edgeCollection.point_count() != 0)
+    throw std::logic_error("EdgeRecord::restore: the collection is not empty");
+  if (header.pointCount > EdgePointCollection::MAX_POINTS ||
+      header.voterCount > EdgePointCollection::MAX_VOTERLIST_SIZE ||
+      header.seedCount > EdgePointCollection::MAX_POINTS)
+    throw std::length_error("EdgeRecord::restore: too many points");
+
+  const std::size_t pointCount = header.pointCount;
+  std::size_t offset = padded(sizeof(EdgeRecordHeader));
+
+  const EdgeRecordPoint* points = reinterpret_cast<const EdgeRecordPoint*>(section(_data, _size, offset, pointCount*sizeof(EdgeRecordPoint)));
+  const char* links = section(_data, _size, offset, 2*pointCount*sizeof(int));
+  const char* votersIndex = section(_data, _size, offset, (pointCount+1)*sizeof(int));
+  const char* votersList = section(_data, _size, offset, header.voterCount*sizeof(int));
+  const int* seedIndices = reinterpret_cast<const int*>(section(_data, _size, offset, header.seedCount*sizeof(int)));
+
+  std::memcpy(&edgeCollection._linkList[0], links, 2*pointCount*sizeof(int));
+  std::memcpy(&edgeCollection._votersIndex[EdgePointCollection::CUDA_OFFSET], votersIndex, (pointCount+1)*sizeof(int));
+  std::memcpy(&edgeCollection._votersList[0], votersList, header.voterCount*sizeof(int));
+
+  // Every index is checked before being used: the record may be stale or corrupt.
+  // The collection stays empty if it is.
+  const int lastIndex = int(pointCount);
+  for (std::size_t i = 0; i < pointCount; ++i) {
+    const int16_t x = points[i].position[0], y = points[i].position[1];
+    if (x < 0 || y < 0 || std::size_t(x) >= header.width || std::size_t(y) >= header.height)
+      throw std::length_error("EdgeRecord::restore: point outside the image");
+  }
+  for (std::size_t i = 0; i < 2*pointCount; ++i) {
+    if (edgeCollection._linkList[i] >= lastIndex)
+      throw std::length_error("EdgeRecord::restore: invalid link");
+  }
+  const int* voterBounds = &edgeCollection._votersIndex[EdgePointCollection::CUDA_OFFSET];
+  if (voterBounds[0] < 0 || std::size_t(voterBounds[pointCount]) != header.voterCount)
+    throw std::length_error("EdgeRecord::restore: invalid voter index");
+  for (std::size_t i = 0; i < pointCount; ++i) {
+    if (voterBounds[i] > voterBounds[i+1])
+      throw std::length_error("EdgeRecord::restore: invalid voter index");
+  }
+  for (std::size_t i = 0; i < header.voterCount; ++i) {
+    if (edgeCollection._votersList[i] < 0 || edgeCollection._votersList[i] >= lastIndex)
+      throw std::length_error("EdgeRecord::restore: invalid voter");
+  }
+  for (std::size_t i = 0; i < header.seedCount; ++i) {
+    if (seedIndices[i] < 0 || seedIndices[i] >= lastIndex)
+      throw std::length_error("EdgeRecord::restore: invalid seed");
+  }
+
+  edgeCollection.point_count() = pointCount;
+  for (std::size_t i = 0; i < pointCount; ++i) {
+    const EdgeRecordPoint& r = points[i];
+    EdgePoint& p = *new (&edgeCollection._edgeList[i]) EdgePoint(r.position[0], r.position[1], r.grad[0], r.grad[1]);
+    p._flowLength = r.flowLength;
+    p._processed = r.processed;
+    p._isMax = r.isMax;
+    p._nSegmentOut = r.nSegmentOut;
+    edgeCollection._edgeMap[edgeCollection.map_index(p.x(), p.y())] = i;
+  }
+
+  seeds.clear();
+  seeds.reserve(header.seedCount);
+  for (std::size_t i = 0; i < header.seedCount; ++i)
+    seeds.push_back(edgeCollection(seedIndices[i]));
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+CutRecord::CutRecord(const std::string& filename)
+  : _data(mapFile(filename, _size))
+{
+  const CutRecordHeader* header = reinterpret_cast<const CutRecordHeader*>(_data);
+  if (_size < sizeof(CutRecordHeader) ||
+      std::memcmp(header->magic, "CCTAGCUT", 8) != 0 ||
+      header->version != kRecordVersion) {
+    ::munmap(const_cast<char*>(_data), _size);
+    throw std::runtime_error("CutRecord: invalid record " + filename);
+  }
+}
+
+CutRecord::~CutRecord()
+{
+  ::munmap(const_cast<char*>(_data), _size);
+}
+
+std::size_t CutRecord::frame() const
+{
+  return reinterpret_cast<const CutRecordHeader*>(_data)->frame;
+}
+
+void CutRecord::write(
+        const std::string& filename,
+        const std::vector<std::vector<ImageCut>>& cuts,
+        std::size_t frame)
+{
+  CutRecordHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, "CCTAGCUT", 8);
+  header.version = kRecordVersion;
+  header.tagCount = cuts.size();
+  header.frame = frame;
+
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs)
+    throw std::runtime_error("CutRecord: unable to create " + filename);
+
+  writePadded(ofs, &header, sizeof(header));
+  for (std::size_t iTag = 0; iTag < cuts.size(); ++iTag) {
+    const CutRecordTag tag = { uint32_t(iTag), uint32_t(cuts[iTag].size()) };
+    writePadded(ofs, &tag, sizeof(tag));
+    for (const ImageCut& cut : cuts[iTag]) {
+      CutRecordCut c;
+      c.start[0] = cut.start().x();
+      c.start[1] = cut.start().y();
+      c.stop[0] = cut.stop().x();
+      c.stop[1] = cut.stop().y();
+      c.stopGrad[0] = cut.stop().dX();
+      c.stopGrad[1] = cut.stop().dY();
+      c.beginSig = cut.beginSig();
+      c.endSig = cut.endSig();
+      c.outOfBounds = cut.outOfBounds();
+      c.nSamples = cut.imgSignal().size();
+      writePadded(ofs, &c, sizeof(c));
+      writePadded(ofs, cut.imgSignal().data(), c.nSamples*sizeof(float));
+    }
+  }
+}
+
+void CutRecord::restore(std::vector<std::vector<ImageCut>>& cuts) const
+{
+  const CutRecordHeader& header = *reinterpret_cast<const CutRecordHeader*>(_data);
+  std::size_t offset = padded(sizeof(CutRecordHeader));
+
+  // The counts come from the file: each is bounded by the bytes left before
+  // anything is allocated for it.
+  if (header.tagCount > (_size - offset) / padded(sizeof(CutRecordTag)))
+    throw std::length_error("CutRecord::restore: too many tags");
+
+  cuts.clear();
+  cuts.resize(header.tagCount);
+  for (std::size_t iTag = 0; iTag < header.tagCount; ++iTag) {
+    const CutRecordTag& tag = *reinterpret_cast<const CutRecordTag*>(section(_data, _size, offset, sizeof(CutRecordTag)));
+    if (tag.cutCount > (_size - offset) / padded(sizeof(CutRecordCut)))
+      throw std::length_error("CutRecord::restore: too many cuts");
+    cuts[iTag].reserve(tag.cutCount);
+    for (std::size_t iCut = 0; iCut < tag.cutCount; ++iCut) {
+      const CutRecordCut& c = *reinterpret_cast<const CutRecordCut*>(section(_data, _size, offset, sizeof(CutRecordCut)));
+      const float* samples = reinterpret_cast<const float*>(section(_data, _size, offset, c.nSamples*sizeof(float)));
+      cuts[iTag].emplace_back(
+        Point2d<Eigen::Vector3f>(c.start[0], c.start[1]),
+        DirectedPoint2d<Eigen::Vector3f>(c.stop[0], c.stop[1], c.stopGrad[0], c.stopGrad[1]),
+        c.beginSig, c.endSig, std::size_t(c.nSamples));
+      ImageCut& cut = cuts[iTag].back();
+      std::copy(samples, samples + c.nSamples, cut.imgSignal().begin());
+      cut.setOutOfBounds(c.outOfBounds != 0);
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+void cctagDetectionFromEdgeRecord(
+        CCTag::List& markers,
+        const EdgeRecord& record,
+        const Parameters& params)
+{
+  EdgePointCollection edgeCollection(record.width(), record.height());
+  std::vector<EdgePoint*> seeds;
+  record.restore(edgeCollection, seeds);
+
+  // The image of the level is only used for its size and for debug output.
+  const cv::Mat src(record.height(), record.width(), CV_8UC1, cv::Scalar(0));
+
+  const int level = record.pyramidLevel();
+  cctagDetectionFromEdges(markers, edgeCollection, src, seeds,
+    record.frame(), level, std::pow(2.0, level), params, nullptr);
+}
+
+} // namespace cctag
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _CCTAG_STAGERECORD_HPP_
+#define _CCTAG_STAGERECORD_HPP_
+
+#include <cctag/Types.hpp>
+#include <cctag/ImageCut.hpp>
+#include <cctag/CCTag.hpp>
+#include <cctag/Params.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cctag {
+
+/* Binary records of the intermediate state of the detection, used to benchmark
+ * or A/B test a single stage over recorded frames without recomputing (nor
+ * storing) the images.
+ * Records are written in host byte order with a fixed-size header followed by
+ * 8-byte aligned sections, so that they can be mapped in memory and read in
+ * place. They are not meant to be portable across architectures.
+ */
+
+/**
+ * @brief Record of an EdgePointCollection after the voting procedure: edge points,
+ * links, voter lists (CSR) and the sorted seeds of one pyramid level.
+ */
+class EdgeRecord
+{
+public:
+  /// Maps the record stored in filename; throws std::runtime_error on failure.
+  explicit EdgeRecord(const std::string& filename);
+  ~EdgeRecord();
+
+  EdgeRecord(const EdgeRecord&) = delete;
+  EdgeRecord& operator=(const EdgeRecord&) = delete;
+
+  std::size_t frame() const;
+  int pyramidLevel() const;
+  std::size_t width() const;
+  std::size_t height() const;
+
+  /**
+   * @brief Restore the recorded state.
+   * @param[out] edgeCollection collection constructed with (width(), height())
+   * @param[out] seeds seeds, pointing into edgeCollection
+   */
+  void restore(EdgePointCollection& edgeCollection, std::vector<EdgePoint*>& seeds) const;
+
+  static void write(
+          const std::string& filename,
+          const EdgePointCollection& edgeCollection,
+          const std::vector<EdgePoint*>& seeds,
+          std::size_t frame,
+          int pyramidLevel);
+
+private:
+  const char* _data;
+  std::size_t _size;
+};
+
+/**
+ * @brief Record of the selected image cuts of every tag of a frame, including
+ * their 1D signals.
+ */
+class CutRecord
+{
+public:
+  /// Maps the record stored in filename; throws std::runtime_error on failure.
+  explicit CutRecord(const std::string& filename);
+  ~CutRecord();
+
+  CutRecord(const CutRecord&) = delete;
+  CutRecord& operator=(const CutRecord&) = delete;
+
+  std::size_t frame() const;
+
+  /**
+   * @brief Restore the recorded cuts.
+   * @param[out] cuts cuts of every tag, in the order of the recorded frame
+   */
+  void restore(std::vector<std::vector<ImageCut>>& cuts) const;
+
+  static void write(
+          const std::string& filename,
+          const std::vector<std::vector<ImageCut>>& cuts,
+          std::size_t frame);
+
+private:
+  const char* _data;
+  std::size_t _size;
+};
+
+/**
+ * @brief Replay the detection from a recorded EdgeRecord, i.e. cctagDetectionFromEdges
+ * without the edge detection and the voting.
+ */
+void cctagDetectionFromEdgeRecord(
+        CCTag::List& markers,
+        const EdgeRecord& record,
+        const Parameters& params);
+
+} // namespace cctag
+
+#endif
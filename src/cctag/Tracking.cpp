@@ -0,0 +1,282 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <cctag/Tracking.hpp>
+#include <cctag/Detection.hpp>
+#include <cctag/Identification.hpp>
+#include <cctag/ImagePyramid.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace cctag {
+
+namespace {
+
+// Smallest side, in pixels of the coarsest processed level, of a region of
+// interest; below that the Canny and voting borders eat the marker.
+const int kMinRoiSideAtLevel = 32;
+
+// Cuts read to confirm the id of a track.
+const std::size_t kConfirmationCuts = 8;
+// A confirmation needs this profile agreement, and may not lose more than
+// kMaxAgreementDrop from the last full identification.
+const float kMinAgreement = 0.75f;
+const float kMaxAgreementDrop = 0.1f;
+
+// Half width, in pixels, of the first neighbourhood searched for the imaged
+// center of a track that is identified again, plus a part of its motion.
+// The default neighbourhood is 20% of the outer radius.
+const float kWarmStartSearch = 0.5f;
+const float kWarmStartMotionRatio = 0.1f;
+
+// The marker of markers nearest to (x, y), closer than maxDistance; markers
+// with an id other than id are ignored unless id is negative.
+CCTag* nearest(CCTag::List & markers, float x, float y, float maxDistance, MarkerID id)
+{
+  CCTag* found = nullptr;
+  for(CCTag & marker : markers)
+  {
+    if(id >= 0 && (marker.getStatus() != status::id_reliable || marker.id() != id))
+      continue;
+    const float dx = marker.x() - x;
+    const float dy = marker.y() - y;
+    const float distance = std::sqrt(dx * dx + dy * dy);
+    if(distance < maxDistance)
+    {
+      maxDistance = distance;
+      found = &marker;
+    }
+  }
+  return found;
+}
+
+// The imaged center of previous moved to candidate, assuming it keeps its
+// offset to the center of the outer ellipse; in the coordinates of candidate.
+Point2d<Eigen::Vector3f> predictCenter(const CCTag & previous, const CCTag & candidate)
+{
+  const numerical::geometry::Ellipse & ellipse = candidate.rescaledOuterEllipse();
+  const numerical::geometry::Ellipse & previousEllipse = previous.rescaledOuterEllipse();
+  return Point2d<Eigen::Vector3f>(ellipse.center().x() + previous.x() - previousEllipse.center().x(),
+                                  ellipse.center().y() + previous.y() - previousEllipse.center().y());
+}
+
+} // anonymous namespace
+
+MarkerTracker::MarkerTracker(const Parameters & params,
+                             const CCTagMarkersBank & bank,
+                             std::size_t fullDetectionInterval,
+                             float roiMargin,
+                             std::size_t identityInterval)
+  : _params(params)
+  , _bank(bank)
+  , _fullDetectionInterval(std::max(fullDetectionInterval, std::size_t(1)))
+  , _roiMargin(roiMargin)
+  , _identityInterval(std::max(identityInterval, std::size_t(1)))
+  , _sinceFullDetection(0)
+  , _lastWasFull(false)
+{
+}
+
+void MarkerTracker::reset()
+{
+  _tracks.clear();
+}
+
+void MarkerTracker::track(CCTag::List & markers,
+                          std::size_t frame,
+                          const cv::Mat & imgGraySrc,
+                          logtime::Mgmt* durations)
+{
+  if(_tracks.empty() || _sinceFullDetection + 1 >= _fullDetectionInterval)
+  {
+    detectFull(markers, frame, imgGraySrc, durations);
+    return;
+  }
+
+  for(Track & track : _tracks)
+  {
+    if(!relocalize(track, frame, imgGraySrc))
+    {
+      // The marker moved too much, left the image or is occluded: the other
+      // tracks are searched again on the whole image.
+      detectFull(markers, frame, imgGraySrc, durations);
+      return;
+    }
+  }
+
+  for(const Track & track : _tracks)
+    markers.push_back(new CCTag(track._marker));
+
+  ++_sinceFullDetection;
+  _lastWasFull = false;
+}
+
+void MarkerTracker::detectFull(CCTag::List & markers,
+                               std::size_t frame,
+                               const cv::Mat & imgGraySrc,
+                               logtime::Mgmt* durations)
+{
+  CCTag::List detected;
+  cctagDetection(detected, 0, frame, imgGraySrc, _params, _bank, true, durations);
+
+  cv::Mat gray = imgGraySrc;
+  if(imgGraySrc.type() == CV_8UC2)
+    cv::extractChannel(imgGraySrc, gray, 0);
+
+  _tracks.clear();
+  for(const CCTag & marker : detected)
+  {
+    if(marker.getStatus() != status::id_reliable)
+      continue;
+    _tracks.emplace_back(marker);
+    _tracks.back()._agreement = agreement(marker, gray);
+  }
+  markers.transfer(markers.end(), detected);
+
+  _sinceFullDetection = 0;
+  _lastWasFull = true;
+}
+
+bool MarkerTracker::relocalize(Track & track, std::size_t frame, const cv::Mat & imgGraySrc)
+{
+  const CCTag & previous = track._marker;
+  const numerical::geometry::Ellipse & ellipse = previous.rescaledOuterEllipse();
+
+  // Only the levels down to the one the marker was found on are needed.
+  Parameters roiParams(_params);
+  const int level = std::max(previous.pyramidLevel(), 0);
+  roiParams._numberOfProcessedMultiresLayers =
+    std::min(std::size_t(level) + 1, _params._numberOfProcessedMultiresLayers);
+
+  // Constant velocity prediction.
+  const float predictedX = previous.x() + track._dx;
+  const float predictedY = previous.y() + track._dy;
+  const float radius = std::max(ellipse.a(), ellipse.b());
+  const float motion = std::sqrt(track._dx * track._dx + track._dy * track._dy);
+  const int coarsest = 1 << (roiParams._numberOfProcessedMultiresLayers - 1);
+  const int halfSide = std::max(int(std::ceil(radius * (1.f + _roiMargin) + motion)),
+                                kMinRoiSideAtLevel * coarsest / 2);
+
+  const cv::Rect roi = cv::Rect(int(predictedX) - halfSide, int(predictedY) - halfSide,
+                                2 * halfSide, 2 * halfSide)
+                     & cv::Rect(0, 0, imgGraySrc.cols, imgGraySrc.rows);
+  if(std::min(roi.width, roi.height) < kMinRoiSideAtLevel * coarsest / 2)
+    return false;
+
+  // The regions change size on every frame, which the CUDA pipes do not like:
+  // they are always processed on the CPU.
+  ImagePyramid imagePyramid(roi.width, roi.height, roiParams._numberOfProcessedMultiresLayers, false);
+  CCTag::List roiMarkers;
+  cctagLocalization(roiMarkers, frame, imgGraySrc(roi), imagePyramid, roiParams);
+  const cv::Mat & roiGray = imagePyramid.getLevel(0)->getSrc();
+
+  CCTag* candidate = nearest(roiMarkers, predictedX - roi.x, predictedY - roi.y, radius, -1);
+  const CCTag* found = nullptr;
+  bool confirmed = false;
+  if(candidate && track._confirmations + 1 < _identityInterval)
+  {
+    confirmed = confirm(track, *candidate, roiGray);
+    if(confirmed)
+      found = candidate;
+  }
+
+  if(!confirmed)
+  {
+    if(candidate)
+    {
+      // Warm start: the optimization of the imaged center begins at the
+      // predicted one, in a neighbourhood of a few pixels.
+      const Point2d<Eigen::Vector3f> center = predictCenter(previous, *candidate);
+      const float shift = std::sqrt(std::pow(center.x() + roi.x - previous.x(), 2.f)
+                                  + std::pow(center.y() + roi.y - previous.y(), 2.f));
+      const numerical::geometry::Ellipse & candidateEllipse = candidate->rescaledOuterEllipse();
+      candidate->setCenterImg(center);
+      candidate->setCenterSearchSize((kWarmStartSearch + kWarmStartMotionRatio * shift) * 2.f
+                                     / std::max(candidateEllipse.a(), candidateEllipse.b()));
+    }
+    cctagIdentification(roiMarkers, frame, imagePyramid, nullptr, roiParams, _bank);
+    found = nearest(roiMarkers, predictedX - roi.x, predictedY - roi.y, radius, previous.id());
+    if(!found)
+      return false;
+  }
+
+  CCTag marker(*found);
+  if(confirmed)
+  {
+    ++track._confirmations;
+  }
+  else
+  {
+    track._agreement = agreement(marker, roiGray);
+    track._confirmations = 0;
+  }
+
+  marker.translate(float(roi.x), float(roi.y));
+  track._dx = marker.x() - previous.x();
+  track._dy = marker.y() - previous.y();
+  track._marker = marker;
+  return true;
+}
+
+bool MarkerTracker::confirm(const Track & track, CCTag & candidate, const cv::Mat & roiGray) const
+{
+  const CCTag & previous = track._marker;
+  const Point2d<Eigen::Vector3f> center = predictCenter(previous, candidate);
+
+  Eigen::Matrix3f mHomography;
+  const float agreement = predictedAgreement(previous, candidate, roiGray, mHomography);
+  if(agreement < kMinAgreement || agreement < track._agreement - kMaxAgreementDrop)
+    return false;
+
+  const std::vector<float> & radiusRatios = _bank.getMarkers()[previous.id()];
+  candidate.setId(previous.id());
+  candidate.setIdSet(previous.idSet());
+  candidate.setRadiusRatios(radiusRatios);
+  candidate.setHomography(mHomography);
+  candidate.setCenterImg(center);
+  candidate.setQuality(previous.quality());
+  try
+  {
+    identification::pushImagedCircles(candidate);
+  }
+  catch(...)
+  {
+    return false;
+  }
+  candidate.setStatus(status::id_reliable);
+  return true;
+}
+
+float MarkerTracker::predictedAgreement(const CCTag & previous,
+                                        const CCTag & candidate,
+                                        const cv::Mat & gray,
+                                        Eigen::Matrix3f & mHomography) const
+{
+  const numerical::geometry::Ellipse & ellipse = candidate.rescaledOuterEllipse();
+  try
+  {
+    identification::computeHomographyFromEllipseAndImagedCenter(ellipse, predictCenter(previous, candidate), mHomography);
+  }
+  catch(...)
+  {
+    return 0.f;
+  }
+  return identification::profileAgreement(
+    ellipse, candidate.rescaledOuterEllipsePoints(), _bank.getMarkers()[previous.id()],
+    mHomography, gray, _params, kConfirmationCuts);
+}
+
+float MarkerTracker::agreement(const CCTag & marker, const cv::Mat & gray) const
+{
+  // Read as confirm() will read it, i.e. not with the optimized homography,
+  // so that the two agreements are comparable.
+  Eigen::Matrix3f mHomography;
+  return predictedAgreement(marker, marker, gray, mHomography);
+}
+
+} // namespace cctag
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _CCTAG_TRACKING_HPP
+#define _CCTAG_TRACKING_HPP
+
+#include <cctag/CCTag.hpp>
+#include <cctag/CCTagMarkersBank.hpp>
+#include <cctag/Params.hpp>
+#include <cctag/utils/LogTime.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace cctag {
+
+/**
+ * @brief Detection of the markers of a video stream that re-localizes the
+ * markers of the previous frame instead of searching the whole image.
+ *
+ * The identified markers of a full detection (cctagDetection) are the
+ * tracks. On the following frames, each track is searched in a region of
+ * interest around its position predicted from its last motion, processing
+ * only the pyramid levels up to the one it was found on. A full detection runs again every
+ * fullDetectionInterval frames, when a track is lost, and when there is
+ * nothing to track. Markers entering the image are therefore found at the
+ * next full detection at the latest.
+ *
+ * The id of a track is not searched in the bank again on every frame: the
+ * re-localized marker is only checked against the profile of the cached id,
+ * on a few cuts rectified with the homography predicted from the motion of
+ * its outer ellipse (identification::profileAgreement). The full
+ * identification runs again when this agreement drops below the one
+ * measured at the last full identification, and every identityInterval
+ * frames; its search of the imaged center then starts from the predicted
+ * one, in a neighbourhood of about a pixel (CCTag::setCenterSearchSize).
+ *
+ * Not thread safe: the frames of a stream must be given one after the other.
+ */
+class MarkerTracker
+{
+public:
+  /**
+   * @param[in] params The detection parameters, copied.
+   * @param[in] bank The marker bank; must outlive the tracker.
+   * @param[in] fullDetectionInterval Maximum number of frames between two full
+   * detections, 1 for a full detection on every frame.
+   * @param[in] roiMargin Margin around a track, relative to the longest
+   * semi-axis of its outer ellipse.
+   * @param[in] identityInterval Maximum number of frames between two full
+   * identifications of a track, 1 to identify on every frame.
+   */
+  MarkerTracker(const Parameters & params,
+                const CCTagMarkersBank & bank,
+                std::size_t fullDetectionInterval = 10,
+                float roiMargin = 0.5f,
+                std::size_t identityInterval = 5);
+
+  /**
+   * @brief Detect the markers of the next frame of the stream.
+   *
+   * @param[out] markers Appended to. After a full detection, all the candidates as returned
+   * by cctagDetection; otherwise the re-localized tracks, all with
+   * status::id_reliable.
+   * @param[in] frame A frame number.
+   * @param[in] imgGraySrc Gray scale or YUYV image, as for cctagDetection.
+   * @param[in] durations Optional timing of the full detections.
+   */
+  void track(CCTag::List & markers,
+             std::size_t frame,
+             const cv::Mat & imgGraySrc,
+             logtime::Mgmt* durations = nullptr);
+
+  /**
+   * @brief Forget the tracks: the next frame gets a full detection, e.g.
+   * after a cut in the video.
+   */
+  void reset();
+
+  /**
+   * @brief Whether the last call to track() ran a full detection.
+   */
+  bool lastWasFullDetection() const { return _lastWasFull; }
+
+  /**
+   * @brief Number of markers currently tracked.
+   */
+  std::size_t trackCount() const { return _tracks.size(); }
+
+private:
+  struct Track
+  {
+    explicit Track(const CCTag & marker) : _marker(marker) { }
+
+    CCTag _marker;
+    float _dx = 0.f;    // motion during the last frame
+    float _dy = 0.f;
+    float _agreement = 0.f;             // profile agreement at the last full identification
+    std::size_t _confirmations = 0;     // frames since the last full identification
+  };
+
+  void detectFull(CCTag::List & markers, std::size_t frame, const cv::Mat & imgGraySrc,
+                  logtime::Mgmt* durations);
+  // Returns false if the track was not found.
+  bool relocalize(Track & track, std::size_t frame, const cv::Mat & imgGraySrc);
+  // Gives candidate the id of the track if its profile still agrees with it.
+  bool confirm(const Track & track, CCTag & candidate, const cv::Mat & roiGray) const;
+  // Profile agreement of candidate with the id of previous, read with the homography
+  // of its outer ellipse and of the imaged center predicted from previous; 0 if there
+  // is no such homography.
+  float predictedAgreement(const CCTag & previous, const CCTag & candidate, const cv::Mat & gray,
+                           Eigen::Matrix3f & mHomography) const;
+  // Agreement of a just identified marker, the reference of the confirmations.
+  float agreement(const CCTag & marker, const cv::Mat & gray) const;
+
+  Parameters _params;
+  const CCTagMarkersBank & _bank;
+  const std::size_t _fullDetectionInterval;
+  const float _roiMargin;
+  const std::size_t _identityInterval;
+
+  std::vector<Track> _tracks;
+  std::size_t _sinceFullDetection;
+  bool _lastWasFull;
+};
+
+} // namespace cctag
+
+#endif
@@ -16,8 +16,12 @@
 
 namespace cctag {
 
+class EdgeRecord;
+
 class EdgePointCollection
 {
+  friend class EdgeRecord; // record/replay of the state after voting, see StageRecord.hpp
+
 public:
   static constexpr size_t MAX_POINTS = size_t(1) << 24;
 private:
@@ -82,13 +82,13 @@ void vote(EdgePointCollection& edgeCollection,
         ilink = edgeCollection(link);
         edgeCollection.set_before(&p, ilink);
         
-        CCTagFileDebug::instance().endVote();
+        CCTAG_VOTE_DEBUG_HOOK(endVote());
         
         link = gradientDirectionDescent(edgeCollection, p, 1, params._distSearch, dx, dy, params._thrGradientMagInVote);
         ilink = edgeCollection(link);
         edgeCollection.set_after(&p, ilink);
         
-        CCTagFileDebug::instance().endVote();
+        CCTAG_VOTE_DEBUG_HOOK(endVote());
     }
     // Vote
     seeds.reserve(pointCount / 2);
@@ -453,7 +453,7 @@ void vote(EdgePointCollection& edgeCollection,
               {
                 ++k;
                 pts.emplace_back(edgePoint->cast<float>());
-                CCTagVisualDebug::instance().drawPoint(cctag::Point2d<Eigen::Vector3f>(pts.back()), cctag::color_red);
+                CCTAG_VISUAL_DEBUG_HOOK(drawPoint(cctag::Point2d<Eigen::Vector3f>(pts.back()), cctag::color_red));
 
                 if (weightedType == INV_GRAD_WEIGHT) {
                   weights.push_back(255 / (edgePoint->normGradient()));
@@ -722,16 +722,16 @@ void vote(EdgePointCollection& edgeCollection,
                         return false;
                     }
                 } else {
-                    CCTagFileDebug::instance().outputFlowComponentAssemblingInfos(FINAL_MEDIAN_TEST_FAILED_WHILE_ASSEMBLING);
+                    CCTAG_FILE_DEBUG_HOOK(outputFlowComponentAssemblingInfos(FINAL_MEDIAN_TEST_FAILED_WHILE_ASSEMBLING));
                     CCTAG_COUT_DEBUG("SmFinal > thrMedianDistanceEllipse in isAnotherSegment");
                 }
             } else {
-                CCTagFileDebug::instance().outputFlowComponentAssemblingInfos(QUALITY_TEST_FAILED_WHILE_ASSEMBLING);
+                CCTAG_FILE_DEBUG_HOOK(outputFlowComponentAssemblingInfos(QUALITY_TEST_FAILED_WHILE_ASSEMBLING));
                 CCTAG_COUT_DEBUG("Quality too high: " << quality);
                 return false;
             }
         } else {
-            CCTagFileDebug::instance().outputFlowComponentAssemblingInfos(MEDIAN_TEST_FAILED_WHILE_ASSEMBLING);
+            CCTAG_FILE_DEBUG_HOOK(outputFlowComponentAssemblingInfos(MEDIAN_TEST_FAILED_WHILE_ASSEMBLING));
             CCTAG_COUT_DEBUG("Test failed !!\n");
             return false;
         }
@@ -0,0 +1,125 @@
+#define BOOST_TEST_MODULE testIdentification
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+#include <cctag/Identification.hpp>
+#include <cctag/CCTagMarkersBank.hpp>
+#include <cctag/Params.hpp>
+#include <cctag/geometry/Ellipse.hpp>
+#include <cctag/geometry/Point.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+const float kCenterX = 320.f;
+const float kCenterY = 240.f;
+const float kRadius = 100.f;
+
+using OuterPoints = std::vector<cctag::DirectedPoint2d<Eigen::Vector3f>>;
+
+// Fronto-parallel marker on a white background: a white center, then alternating
+// black and white rings up to the black outer ring.
+cv::Mat renderMarker(const std::vector<float>& radiusRatios)
+{
+    cv::Mat src(480, 640, CV_8UC1, cv::Scalar(255));
+    for (int y = 0; y < src.rows; ++y)
+    for (int x = 0; x < src.cols; ++x) {
+        const float r = std::hypot(x - kCenterX, y - kCenterY) / kRadius;
+        if (r >= 1.f)
+            continue;
+        std::size_t ring = 0;
+        while (ring < radiusRatios.size() && r >= 1.f / radiusRatios[ring])
+            ++ring;
+        src.at<uchar>(y, x) = ring % 2 ? 0 : 255;
+    }
+    return src;
+}
+
+// Random gray blocks of 2x2 pixels, as in foliage or gravel.
+cv::Mat renderTexture()
+{
+    cv::Mat src(480, 640, CV_8UC1);
+    uint32_t state = 12345;
+    for (int y = 0; y < src.rows; y += 2)
+    for (int x = 0; x < src.cols; x += 2) {
+        state = state * 1664525u + 1013904223u;
+        src(cv::Rect(x, y, 2, 2)).setTo(cv::Scalar(state >> 24));
+    }
+    return src;
+}
+
+cctag::numerical::geometry::Ellipse outerEllipse()
+{
+    return cctag::numerical::geometry::Ellipse(cctag::Point2d<Eigen::Vector3f>(kCenterX, kCenterY), kRadius, kRadius, 0.f);
+}
+
+// Points of the outer ellipse sorted by angle, the gradient pointing outwards.
+OuterPoints outerPoints()
+{
+    OuterPoints points;
+    for (int i = 0; i < 64; ++i) {
+        const float angle = 2 * M_PI * i / 64;
+        points.emplace_back(kCenterX + kRadius * std::cos(angle), kCenterY + kRadius * std::sin(angle),
+                            std::cos(angle), std::sin(angle));
+    }
+    return points;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(test_plausibleSignal)
+
+BOOST_AUTO_TEST_CASE(test_marker_is_plausible)
+{
+    const cctag::CCTagMarkersBank bank(3);
+    const cctag::Parameters params(3);
+    for (std::size_t id : { 0, 7, 31 }) {
+        const cv::Mat src = renderMarker(bank.getMarkers()[id]);
+        BOOST_CHECK_MESSAGE(cctag::identification::plausibleSignal(outerEllipse(), outerPoints(), bank.getMarkers(), src, params),
+                            "marker " << id << " rejected");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_texture_is_implausible)
+{
+    const cctag::CCTagMarkersBank bank(3);
+    const cctag::Parameters params(3);
+    const cv::Mat src = renderTexture();
+    BOOST_CHECK(!cctag::identification::plausibleSignal(outerEllipse(), outerPoints(), bank.getMarkers(), src, params));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(test_profileAgreement)
+
+BOOST_AUTO_TEST_CASE(test_right_id_reads_highest)
+{
+    const cctag::CCTagMarkersBank bank(3);
+    const cctag::Parameters params(3);
+    const std::size_t id = 7;
+    const cv::Mat src = renderMarker(bank.getMarkers()[id]);
+
+    Eigen::Matrix3f mHomography;
+    cctag::identification::computeHomographyFromEllipseAndImagedCenter(
+        outerEllipse(), cctag::Point2d<Eigen::Vector3f>(kCenterX, kCenterY), mHomography);
+
+    const float right = cctag::identification::profileAgreement(
+        outerEllipse(), outerPoints(), bank.getMarkers()[id], mHomography, src, params, 8);
+    BOOST_CHECK_GT(right, 0.9f);
+
+    // The neighbouring ids of the bank differ from it by a single ring.
+    for (std::size_t neighbour : { id - 1, id + 1 }) {
+        const float wrong = cctag::identification::profileAgreement(
+            outerEllipse(), outerPoints(), bank.getMarkers()[neighbour], mHomography, src, params, 8);
+        BOOST_CHECK_MESSAGE(wrong < right - 0.03f, "id " << neighbour << " reads " << wrong << ", id " << id << " reads " << right);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,121 @@
+#define BOOST_TEST_MODULE testStageRecord
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <cctag/StageRecord.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace bfs = boost::filesystem;
+
+BOOST_AUTO_TEST_SUITE(test_stageRecord)
+
+BOOST_AUTO_TEST_CASE(test_edgeRecord_roundtrip)
+{
+    const bfs::path path = bfs::temp_directory_path() / bfs::unique_path("cctag-%%%%-%%%%.edges");
+
+    {
+        cctag::EdgePointCollection edgeCollection(64, 48);
+        edgeCollection.add_point(10, 12, 1.f, 2.f);
+        edgeCollection.add_point(20, 22, -3.f, 4.f);
+        edgeCollection.add_point(30, 32, 5.f, -6.f);
+        edgeCollection.set_before(edgeCollection(0), 1);
+        edgeCollection.set_after(edgeCollection(0), 2);
+        edgeCollection.create_voter_lists({ { 1, 2 }, {}, { 0 } });
+        edgeCollection(0)->_isMax = 2;
+
+        const std::vector<cctag::EdgePoint*> seeds = { edgeCollection(0), edgeCollection(2) };
+        cctag::EdgeRecord::write(path.string(), edgeCollection, seeds, 7, 1);
+    }
+
+    cctag::EdgeRecord record(path.string());
+    BOOST_CHECK_EQUAL(record.frame(), 7);
+    BOOST_CHECK_EQUAL(record.pyramidLevel(), 1);
+    BOOST_REQUIRE_EQUAL(record.width(), 64);
+    BOOST_REQUIRE_EQUAL(record.height(), 48);
+
+    cctag::EdgePointCollection edgeCollection(record.width(), record.height());
+    std::vector<cctag::EdgePoint*> seeds;
+    record.restore(edgeCollection, seeds);
+
+    BOOST_REQUIRE_EQUAL(edgeCollection.get_point_count(), 3);
+    BOOST_CHECK_EQUAL(edgeCollection(20, 22), edgeCollection(1));
+    BOOST_CHECK_EQUAL(edgeCollection(30, 32)->dY(), -6.f);
+    BOOST_CHECK_EQUAL(edgeCollection.before(edgeCollection(0)), edgeCollection(1));
+    BOOST_CHECK_EQUAL(edgeCollection.after(edgeCollection(0)), edgeCollection(2));
+    BOOST_CHECK_EQUAL(edgeCollection.voters_size(edgeCollection(0)), 2);
+    BOOST_CHECK_EQUAL(edgeCollection.voters_size(edgeCollection(1)), 0);
+    BOOST_CHECK_EQUAL(*edgeCollection.voters(edgeCollection(2)).first, 0);
+    BOOST_REQUIRE_EQUAL(seeds.size(), 2);
+    BOOST_CHECK_EQUAL(seeds[0], edgeCollection(0));
+    BOOST_CHECK_EQUAL(seeds[0]->_isMax, 2);
+    BOOST_CHECK_EQUAL(seeds[1], edgeCollection(2));
+
+    bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(test_cutRecord_roundtrip)
+{
+    const bfs::path path = bfs::temp_directory_path() / bfs::unique_path("cctag-%%%%-%%%%.cuts");
+
+    std::vector<std::vector<cctag::ImageCut>> cuts(2);
+    cuts[1].emplace_back(cctag::Point2d<Eigen::Vector3f>(1.f, 2.f),
+                         cctag::DirectedPoint2d<Eigen::Vector3f>(3.f, 4.f, 0.5f, -0.5f),
+                         0.25f, 1.f, std::size_t(3));
+    cuts[1][0].imgSignal() = { 10.f, 20.f, 30.f };
+    cuts[1][0].setOutOfBounds(true);
+    cctag::CutRecord::write(path.string(), cuts, 3);
+
+    cctag::CutRecord record(path.string());
+    std::vector<std::vector<cctag::ImageCut>> restored;
+    record.restore(restored);
+
+    BOOST_CHECK_EQUAL(record.frame(), 3);
+    BOOST_REQUIRE_EQUAL(restored.size(), 2);
+    BOOST_CHECK(restored[0].empty());
+    BOOST_REQUIRE_EQUAL(restored[1].size(), 1);
+    const cctag::ImageCut& cut = restored[1][0];
+    BOOST_CHECK_EQUAL(cut.start().x(), 1.f);
+    BOOST_CHECK_EQUAL(cut.stop().y(), 4.f);
+    BOOST_CHECK_EQUAL(cut.stop().dY(), -0.5f);
+    BOOST_CHECK_EQUAL(cut.beginSig(), 0.25f);
+    BOOST_CHECK(cut.outOfBounds());
+    BOOST_CHECK(cut.imgSignal() == cuts[1][0].imgSignal());
+
+    bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(test_cutRecord_corrupt_counts)
+{
+    const bfs::path path = bfs::temp_directory_path() / bfs::unique_path("cctag-%%%%-%%%%.cuts");
+
+    std::vector<std::vector<cctag::ImageCut>> cuts(1);
+    cuts[0].emplace_back(cctag::Point2d<Eigen::Vector3f>(1.f, 2.f),
+                         cctag::DirectedPoint2d<Eigen::Vector3f>(3.f, 4.f, 0.5f, -0.5f),
+                         0.25f, 1.f, std::size_t(3));
+    cctag::CutRecord::write(path.string(), cuts, 3);
+
+    // Overwrites the uint32 at offset with value.
+    const auto corrupt = [&](std::streamoff offset, uint32_t value) {
+        std::fstream fs(path.string(), std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(offset);
+        fs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    std::vector<std::vector<cctag::ImageCut>> restored;
+
+    // the tag count of the header, then the cut count of the first tag
+    corrupt(12, 0xFFFFFFFF);
+    BOOST_CHECK_THROW(cctag::CutRecord(path.string()).restore(restored), std::length_error);
+    corrupt(12, 1);
+    corrupt(28, 0xFFFFFFFF);
+    BOOST_CHECK_THROW(cctag::CutRecord(path.string()).restore(restored), std::length_error);
+
+    bfs::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "AllocCounters.hpp"
+
+#ifdef CCTAG_ALLOC_ACCOUNTING
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#error "CCTAG_ALLOC_ACCOUNTING requires malloc_usable_size or malloc_size"
+#endif
+#endif
+
+namespace cctag {
+namespace logtime {
+
+#ifdef CCTAG_ALLOC_ACCOUNTING
+
+static std::atomic<uint64_t> allocCount( 0 );
+static std::atomic<uint64_t> allocBytes( 0 );
+static std::atomic<uint64_t> allocLive( 0 );
+static std::atomic<uint64_t> allocPeak( 0 );
+
+// The blocks are plain malloc blocks, sized by the allocator itself: a block
+// allocated by another operator new (e.g. of a statically linked libstdc++) can
+// safely be freed by ours, and conversely, whatever the library interposes.
+static std::size_t blockSize( void* p )
+{
+#if defined(__GLIBC__)
+    return malloc_usable_size( p );
+#else
+    return malloc_size( p );
+#endif
+}
+
+static void* countedAlloc( std::size_t size )
+{
+    void* p = std::malloc( size );
+    if( p == nullptr ) return nullptr;
+    size = blockSize( p );
+
+    allocCount.fetch_add( 1, std::memory_order_relaxed );
+    allocBytes.fetch_add( size, std::memory_order_relaxed );
+    const uint64_t live = allocLive.fetch_add( size, std::memory_order_relaxed ) + size;
+    uint64_t peak = allocPeak.load( std::memory_order_relaxed );
+    while( live > peak && not allocPeak.compare_exchange_weak( peak, live, std::memory_order_relaxed ) )
+    { }
+
+    return p;
+}
+
+static void countedFree( void* ptr )
+{
+    if( ptr == nullptr ) return;
+    // saturated: the block may have been allocated before the counting began
+    const uint64_t size = blockSize( ptr );
+    uint64_t live = allocLive.load( std::memory_order_relaxed );
+    while( not allocLive.compare_exchange_weak( live, live > size ? live - size : 0, std::memory_order_relaxed ) )
+    { }
+    std::free( ptr );
+}
+
+static void* countedNew( std::size_t size )
+{
+    if( size == 0 ) size = 1;
+    for( ;; ) {
+        void* p = countedAlloc( size );
+        if( p ) return p;
+        std::new_handler handler = std::get_new_handler();
+        if( not handler ) throw std::bad_alloc();
+        handler();
+    }
+}
+
+bool allocAccountingEnabled( )
+{
+    return true;
+}
+
+AllocStats allocSnapshot( )
+{
+    AllocStats stats;
+    stats._count = allocCount.load( std::memory_order_relaxed );
+    stats._bytes = allocBytes.load( std::memory_order_relaxed );
+    stats._live  = allocLive.load( std::memory_order_relaxed );
+    stats._peak  = allocPeak.load( std::memory_order_relaxed );
+    return stats;
+}
+
+void resetAllocPeak( )
+{
+    allocPeak.store( allocLive.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+}
+
+#else // CCTAG_ALLOC_ACCOUNTING
+
+bool allocAccountingEnabled( )
+{
+    return false;
+}
+
+AllocStats allocSnapshot( )
+{
+    return AllocStats{ 0, 0, 0, 0 };
+}
+
+void resetAllocPeak( )
+{ }
+
+#endif // CCTAG_ALLOC_ACCOUNTING
+
+} // logtime
+} // cctag
+
+#ifdef CCTAG_ALLOC_ACCOUNTING
+
+void* operator new( std::size_t size )
+{
+    return cctag::logtime::countedNew( size );
+}
+
+void* operator new[]( std::size_t size )
+{
+    return cctag::logtime::countedNew( size );
+}
+
+void* operator new( std::size_t size, const std::nothrow_t& ) noexcept
+{
+    try { return cctag::logtime::countedNew( size ); }
+    catch( ... ) { return nullptr; }
+}
+
+void* operator new[]( std::size_t size, const std::nothrow_t& ) noexcept
+{
+    try { return cctag::logtime::countedNew( size ); }
+    catch( ... ) { return nullptr; }
+}
+
+void operator delete( void* ptr ) noexcept
+{
+    cctag::logtime::countedFree( ptr );
+}
+
+void operator delete[]( void* ptr ) noexcept
+{
+    cctag::logtime::countedFree( ptr );
+}
+
+void operator delete( void* ptr, const std::nothrow_t& ) noexcept
+{
+    cctag::logtime::countedFree( ptr );
+}
+
+void operator delete[]( void* ptr, const std::nothrow_t& ) noexcept
+{
+    cctag::logtime::countedFree( ptr );
+}
+
+void operator delete( void* ptr, std::size_t ) noexcept
+{
+    cctag::logtime::countedFree( ptr );
+}
+
+void operator delete[]( void* ptr, std::size_t ) noexcept
+{
+    cctag::logtime::countedFree( ptr );
+}
+
+#endif // CCTAG_ALLOC_ACCOUNTING
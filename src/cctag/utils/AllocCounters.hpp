@@ -0,0 +1,44 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace cctag {
+namespace logtime {
+
+/* Heap allocation accounting. When the library is built with the
+ * CCTAG_ALLOC_ACCOUNTING option, the global operator new/delete are replaced
+ * by counting versions. Counters are process-wide: allocations made by other
+ * threads running concurrently with a detection are accounted as well.
+ * The sizes are those of the malloc blocks (malloc_usable_size), which may be
+ * a little larger than the requested ones. Blocks allocated before the library
+ * was loaded and freed afterwards make _live approximate.
+ * Only allocations through operator new are seen: OpenCV (cv::fastMalloc, hence
+ * cv::Mat buffers), Eigen aligned allocations and TBB scalable allocations call
+ * malloc directly and are not counted.
+ */
+struct AllocStats
+{
+    uint64_t _count; ///< Number of allocations
+    uint64_t _bytes; ///< Number of allocated bytes
+    uint64_t _live;  ///< Bytes currently allocated
+    uint64_t _peak;  ///< Peak of _live since the last resetAllocPeak()
+};
+
+/// @return true if the library has been built with CCTAG_ALLOC_ACCOUNTING.
+bool allocAccountingEnabled( );
+
+/// @return the totals since the program started; all zeros if not enabled.
+AllocStats allocSnapshot( );
+
+/// Resets the peak to the number of bytes currently allocated.
+void resetAllocPeak( );
+
+} // logtime
+} // cctag
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#ifndef _CCTAG_DEADLINE_HPP_
+#define _CCTAG_DEADLINE_HPP_
+
+#include <atomic>
+#include <chrono>
+
+namespace cctag {
+
+/**
+ * @brief Time budget of a detection. Once it is reached, the detection skips
+ * the work it has not started yet, lowest priority first, and returns the
+ * markers that are complete.
+ *
+ * reached() may be called from several threads.
+ */
+class Deadline
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Deadline( Clock::time_point end )
+    : _end( end )
+    , _truncated( false )
+  { }
+
+  explicit Deadline( std::chrono::microseconds budget )
+    : Deadline( Clock::now() + budget )
+  { }
+
+  /**
+   * @brief Whether the work about to start has to be skipped; the detection
+   * is then truncated.
+   */
+  bool reached()
+  {
+    if( _truncated.load( std::memory_order_relaxed ) )
+      return true;
+    if( Clock::now() < _end )
+      return false;
+    _truncated.store( true, std::memory_order_relaxed );
+    return true;
+  }
+
+  /**
+   * @brief Whether some work was skipped because of the deadline.
+   */
+  bool truncated() const
+  {
+    return _truncated.load( std::memory_order_relaxed );
+  }
+
+private:
+  const Clock::time_point _end;
+  std::atomic<bool>       _truncated;
+};
+
+} // namespace cctag
+
+#endif
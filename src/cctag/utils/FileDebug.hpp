@@ -33,6 +33,22 @@
 #define RAISED_EXCEPTION 12
 #define PASS_ALLTESTS 30
 
+/* Hooks to be used in hot loops instead of calling CCTagFileDebug::instance()
+ * directly: they expand to nothing when the corresponding output is not compiled
+ * in, so release builds pay neither the call nor the singleton access.
+ * Usage: CCTAG_FILE_DEBUG_HOOK(outputMarkerInfos(marker)); */
+#ifdef CCTAG_SERIALIZE
+#define CCTAG_FILE_DEBUG_HOOK(call) cctag::CCTagFileDebug::instance().call
+#else
+#define CCTAG_FILE_DEBUG_HOOK(call) ((void)0)
+#endif
+
+#if defined(CCTAG_SERIALIZE) && defined(CCTAG_VOTE_DEBUG)
+#define CCTAG_VOTE_DEBUG_HOOK(call) cctag::CCTagFileDebug::instance().call
+#else
+#define CCTAG_VOTE_DEBUG_HOOK(call) ((void)0)
+#endif
+
 namespace cctag {
 
         class CCTagFileDebug : public Singleton<CCTagFileDebug> {
@@ -18,23 +18,52 @@ bool Mgmt::Measurement::doPrint( ) const
 void Mgmt::Measurement::print( std::ostream& ostr ) const
 {
     if( not _probe ) return;
-    ostr << _probe << ": "
+    ostr << _probe;
+    if( _level >= 0 ) ostr << " (level " << _level << ")";
+    ostr << ": "
          << bacc::mean(_ms_acc) << "ms "
          // << bacc::mean(_us_acc) << "us"
-         << std::endl;
+         ;
+    for( int i = 0; i < PerfCounters::NumEvents; ++i ) {
+        if( _has_counter[i] )
+            ostr << PerfCounters::name(i) << "=" << uint64_t( bacc::mean(_counter_acc[i]) ) << " ";
+    }
+    if( _has_counter[PerfCounters::Cycles] && _has_counter[PerfCounters::Instructions] ) {
+        const double cycles = bacc::mean(_counter_acc[PerfCounters::Cycles]);
+        if( cycles > 0 )
+            ostr << "IPC=" << bacc::mean(_counter_acc[PerfCounters::Instructions]) / cycles << " ";
+    }
+    if( _has_allocs ) {
+        ostr << "allocs=" << uint64_t( bacc::mean(_alloc_count_acc) ) << " "
+             << "alloc-bytes=" << uint64_t( bacc::mean(_alloc_bytes_acc) ) << " "
+             << "peak-bytes=" << uint64_t( bacc::mean(_alloc_peak_acc) );
+    }
+    ostr << std::endl;
 }
 
-Mgmt::Mgmt( int rsvp )
+Mgmt::Mgmt( int rsvp, bool hardwareCounters )
     : _previous_time( btime::microsec_clock::local_time() )
     , _durations( rsvp )
     , _reserved( rsvp )
-    , _idx( 0 )
-{ }
+    , _used( 0 )
+    , _allocs( allocAccountingEnabled() )
+{
+    if( hardwareCounters ) {
+        _counters.reset( new PerfCounters );
+        // Quietly fall back to wall time only when counters are unavailable.
+        if( not _counters->enabled() ) _counters.reset();
+    }
+    resetStartTime();
+}
 
 void Mgmt::resetStartTime( )
 {
     _previous_time = btime::microsec_clock::local_time();
-    _idx = 0;
+    if( _counters ) _counters->read( _previous_counts );
+    if( _allocs ) {
+        resetAllocPeak();
+        _previous_allocs = allocSnapshot();
+    }
 }
 
 void Mgmt::print( std::ostream& ostr ) const
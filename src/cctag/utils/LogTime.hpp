@@ -7,11 +7,16 @@
  */
 #pragma once
 
+#include <cctag/utils/AllocCounters.hpp>
+#include <cctag/utils/PerfCounters.hpp>
+
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
 
 #include <cstddef>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -28,42 +33,117 @@ struct Mgmt
     public:
         Measurement( )
             : _probe( nullptr )
-        { }
+            , _level( -1 )
+            , _has_allocs( false )
+        {
+            for( bool& b : _has_counter ) b = false;
+        }
+
+        // Whether this measurement is the one of the given probe.
+        bool is( const char* probename, int level ) const {
+            return _probe && _level == level && std::strcmp( _probe, probename ) == 0;
+        }
 
-        void log( const char* probename, const btime::time_duration& duration ) {
-            if( not _probe ) _probe = strdup( probename );
+        void log( const char* probename, int level, const btime::time_duration& duration ) {
+            if( not _probe ) {
+                _probe = strdup( probename );
+                _level = level;
+            }
             _ms_acc( duration.total_milliseconds() );
             _us_acc( duration.total_microseconds() );
         }
 
+        void log( const PerfCounters::Sample& delta ) {
+            for( int i = 0; i < PerfCounters::NumEvents; ++i ) {
+                if( not delta._valid[i] ) continue;
+                _has_counter[i] = true;
+                _counter_acc[i]( double( delta._value[i] ) );
+            }
+        }
+
+        void log( const AllocStats& delta ) {
+            _has_allocs = true;
+            _alloc_count_acc( double( delta._count ) );
+            _alloc_bytes_acc( double( delta._bytes ) );
+            _alloc_peak_acc( double( delta._peak ) );
+        }
+
         bool doPrint( ) const;
 
         void print( std::ostream& ostr ) const;
 
     private:
         const char* _probe;
+        int         _level;
         bacc::accumulator_set<long, bacc::features<bacc::tag::mean> > _ms_acc;
         bacc::accumulator_set<long, bacc::features<bacc::tag::mean> > _us_acc;
+        bacc::accumulator_set<double, bacc::features<bacc::tag::mean> > _counter_acc[PerfCounters::NumEvents];
+        bool _has_counter[PerfCounters::NumEvents];
+        bacc::accumulator_set<double, bacc::features<bacc::tag::mean> > _alloc_count_acc;
+        bacc::accumulator_set<double, bacc::features<bacc::tag::mean> > _alloc_bytes_acc;
+        bacc::accumulator_set<double, bacc::features<bacc::tag::mean> > _alloc_peak_acc;
+        bool _has_allocs;
     };
 
     btime::ptime             _previous_time;
     std::vector<Measurement> _durations;
     int                      _reserved;
-    int                      _idx;
+    int                      _used;
+
+    // Optional hardware counters, see PerfCounters.
+    std::unique_ptr<PerfCounters> _counters;
+    PerfCounters::Sample          _previous_counts;
+
+    // Heap allocations, only when built with CCTAG_ALLOC_ACCOUNTING.
+    bool                          _allocs;
+    AllocStats                    _previous_allocs;
+
+    explicit Mgmt( int rsvp, bool hardwareCounters = false );
 
-    explicit Mgmt( int rsvp );
+    bool hasHardwareCounters( ) const { return _counters != nullptr; }
 
     void resetStartTime( );
 
-    void log( const char* probename ) {
+    /* Logs the time, counters and allocations since the previous probe. The
+     * measurements are kept per probe name and level, so that a probe skipped in
+     * some frames does not shift the others.
+     */
+    void log( const char* probename, int level = -1 ) {
         // std::cerr << "logging >>>" << probename << "<<<" << std::endl;
-        if( _idx >= _reserved ) return;
+        int idx = 0;
+        while( idx < _used && not _durations[idx].is( probename, level ) ) ++idx;
+        if( idx == _used ) {
+            if( _used >= _reserved ) return;
+            ++_used;
+        }
 
         btime::ptime now( btime::microsec_clock::local_time() );
         btime::time_duration duration = now - _previous_time;
         _previous_time = now;
-        _durations[_idx].log( probename, duration );
-        _idx++;
+        _durations[idx].log( probename, level, duration );
+        if( _counters ) {
+            PerfCounters::Sample counts;
+            _counters->read( counts );
+            PerfCounters::Sample delta = counts;
+            for( int i = 0; i < PerfCounters::NumEvents; ++i ) {
+                delta._valid[i] = counts._valid[i] && _previous_counts._valid[i];
+                delta._value[i] = counts._value[i] - _previous_counts._value[i];
+            }
+            _durations[idx].log( delta );
+            _previous_counts = counts;
+        }
+        if( _allocs ) {
+            // the peak is reported relatively to what was live when the stage started
+            const AllocStats allocs = allocSnapshot();
+            AllocStats delta;
+            delta._count = allocs._count - _previous_allocs._count;
+            delta._bytes = allocs._bytes - _previous_allocs._bytes;
+            delta._live  = allocs._live;
+            delta._peak  = allocs._peak > _previous_allocs._live ? allocs._peak - _previous_allocs._live : 0;
+            _durations[idx].log( delta );
+            resetAllocPeak();
+            _previous_allocs = allocSnapshot();
+        }
     }
 
     void print( std::ostream& ostr ) const;
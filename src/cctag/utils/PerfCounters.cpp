@@ -0,0 +1,153 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "PerfCounters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+
+#include <tbb/task_scheduler_observer.h>
+#endif
+
+namespace cctag {
+namespace logtime {
+
+#ifdef __linux__
+static int openCounter( uint32_t type, uint64_t config )
+{
+    struct perf_event_attr attr;
+    std::memset( &attr, 0, sizeof(attr) );
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    const int fd = static_cast<int>( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+    if( fd < 0 ) return -1;
+    ioctl( fd, PERF_EVENT_IOC_RESET, 0 );
+    ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+    return fd;
+}
+#endif
+
+#ifdef __linux__
+// Opens the counters of the TBB threads when they enter the scheduler.
+class PerfCounters::Observer : public tbb::task_scheduler_observer
+{
+public:
+    explicit Observer( PerfCounters& counters )
+        : _counters( counters )
+    {
+        observe( true );
+    }
+
+    ~Observer( )
+    {
+        observe( false );
+    }
+
+    void on_scheduler_entry( bool ) override
+    {
+        _counters.openThread( );
+    }
+
+private:
+    PerfCounters& _counters;
+};
+#else
+class PerfCounters::Observer { };
+#endif
+
+PerfCounters::PerfCounters( )
+    : _enabled( false )
+{
+    for( int i = 0; i < NumEvents; ++i ) _opened[i] = false;
+#ifdef __linux__
+    openThread( );
+    const ThreadCounters& counters = _threads.begin()->second;
+    for( int i = 0; i < NumEvents; ++i ) {
+        _opened[i] = counters._fd[i] >= 0;
+        _enabled = _enabled || _opened[i];
+    }
+    if( _enabled ) _observer.reset( new Observer( *this ) );
+#endif
+}
+
+PerfCounters::~PerfCounters( )
+{
+    _observer.reset( );
+#ifdef __linux__
+    for( const auto& thread : _threads ) {
+        for( int i = 0; i < NumEvents; ++i ) {
+            if( thread.second._fd[i] >= 0 ) close( thread.second._fd[i] );
+        }
+    }
+#endif
+}
+
+void PerfCounters::openThread( )
+{
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock( _mutex );
+    const std::thread::id id = std::this_thread::get_id();
+    if( _threads.count( id ) ) return;
+    ThreadCounters& counters = _threads[id];
+    static const std::pair<uint32_t, uint64_t> events[NumEvents] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES } };
+    for( int i = 0; i < NumEvents; ++i ) {
+        counters._fd[i] = openCounter( events[i].first, events[i].second );
+    }
+#endif
+}
+
+bool PerfCounters::read( Sample& sample )
+{
+    for( int i = 0; i < NumEvents; ++i ) {
+        sample._value[i] = 0;
+        sample._valid[i] = false;
+    }
+    if( not _enabled ) return false;
+#ifdef __linux__
+    openThread( );
+    std::lock_guard<std::mutex> lock( _mutex );
+    for( int i = 0; i < NumEvents; ++i ) sample._valid[i] = _opened[i];
+    for( const auto& thread : _threads ) {
+        for( int i = 0; i < NumEvents; ++i ) {
+            if( thread.second._fd[i] < 0 ) continue;
+            uint64_t value;
+            if( ::read( thread.second._fd[i], &value, sizeof(value) ) == sizeof(value) )
+                sample._value[i] += value;
+            else
+                sample._valid[i] = false;
+        }
+    }
+#endif
+    return true;
+}
+
+const char* PerfCounters::name( int event )
+{
+    switch( event ) {
+    case Cycles       : return "cycles";
+    case Instructions : return "instructions";
+    case LLCMisses    : return "LLC-misses";
+    case BranchMisses : return "branch-misses";
+    default           : return "unknown";
+    }
+}
+
+} // logtime
+} // cctag
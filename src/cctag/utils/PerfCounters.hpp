@@ -0,0 +1,70 @@
+/*
+ * Copyright 2016, Simula Research Laboratory
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace cctag {
+namespace logtime {
+
+/* Hardware performance counters (cycles, instructions, LLC misses, branch misses)
+ * read through perf_event_open on Linux.
+ * perf counts one thread per counter: each thread gets its own counters, opened
+ * when it first enters the TBB scheduler or calls read(), and read() returns the
+ * sum over all of them. The work of the TBB worker threads is therefore included,
+ * from their first task after the construction on. If no counter can be opened
+ * (other OS, perf_event_paranoid, containers...) the object is disabled and read()
+ * returns false.
+ */
+class PerfCounters
+{
+public:
+    enum Event { Cycles = 0, Instructions, LLCMisses, BranchMisses, NumEvents };
+
+    struct Sample
+    {
+        uint64_t _value[NumEvents];
+        bool     _valid[NumEvents];
+    };
+
+    PerfCounters( );
+    ~PerfCounters( );
+
+    PerfCounters( const PerfCounters& ) = delete;
+    PerfCounters& operator=( const PerfCounters& ) = delete;
+
+    bool enabled( ) const { return _enabled; }
+
+    bool read( Sample& sample );
+
+    static const char* name( int event );
+
+private:
+    class Observer;
+
+    struct ThreadCounters
+    {
+        int _fd[NumEvents];
+    };
+
+    // Opens the counters of the calling thread, if not done yet.
+    void openThread( );
+
+    std::mutex                                 _mutex; // protects _threads
+    std::map<std::thread::id, ThreadCounters>  _threads;
+    bool                                       _opened[NumEvents];
+    bool                                       _enabled;
+    std::unique_ptr<Observer>                  _observer;
+};
+
+} // logtime
+} // cctag
@@ -16,6 +16,15 @@
 
 #include <boost/filesystem.hpp>
 
+/* Same as CCTAG_FILE_DEBUG_HOOK (see FileDebug.hpp) for the visual debug:
+ * the arguments are not even evaluated when CCTAG_SERIALIZE is off.
+ * Usage: CCTAG_VISUAL_DEBUG_HOOK(drawPoint(point, cctag::color_red)); */
+#ifdef CCTAG_SERIALIZE
+#define CCTAG_VISUAL_DEBUG_HOOK(call) cctag::CCTagVisualDebug::instance().call
+#else
+#define CCTAG_VISUAL_DEBUG_HOOK(call) ((void)0)
+#endif
+
 namespace cctag
 {
 